@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bitmap.h"
+#include "ext2.h"
+
+#define BENCH_BITMAP_BYTES MAX_BLOCK_SIZE
+#define BENCH_BITS (BENCH_BITMAP_BYTES * 8)
+#define BENCH_ROUNDS 200000
+
+typedef int (*ScanFunc)(const BYTE* bitmap, unsigned int nbits);
+
+// 原来分配器中的写法：逐字节跳过 0xff，再用 getOffset 逐位查找
+static int byteScan(const BYTE* bitmap, unsigned int nbits) {
+  for (unsigned int i = 0; i < (nbits + 7) / 8; i++) {
+    if (bitmap[i] != 0xff) {
+      unsigned int bit = i * 8 + getOffset(bitmap[i]);
+      return bit < nbits ? (int)bit : -1;
+    }
+  }
+  return -1;
+}
+
+static double elapsedNs(struct timespec* start, struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+static double measure(ScanFunc scan, const BYTE* bitmap, int expect) {
+  struct timespec start, end;
+  volatile int sink = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCH_ROUNDS; i++) {
+    sink += scan(bitmap, BENCH_BITS);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (scan(bitmap, BENCH_BITS) != expect) {
+    printf("wrong result\n");
+    exit(1);
+  }
+  return elapsedNs(&start, &end) / BENCH_ROUNDS;
+}
+
+// 随机位图上几种实现的结果必须一致
+static int checkRandom() {
+  BYTE bitmap[BENCH_BITMAP_BYTES];
+  srand(1);
+  for (int round = 0; round < 10000; round++) {
+    memset(bitmap, 0xff, sizeof(bitmap));
+    unsigned int nbits = 1 + rand() % BENCH_BITS;
+    int zeros = rand() % 4;
+    for (int i = 0; i < zeros; i++) {
+      setBit(bitmap, rand() % BENCH_BITS, 0);
+    }
+    int expect = byteScan(bitmap, nbits);
+    if (findFirstZeroBitScalar(bitmap, nbits) != expect ||
+        findFirstZeroBitAvx2(bitmap, nbits) != expect ||
+        findFirstZeroBit(bitmap, nbits) != expect) {
+      printf("mismatch with nbits %u\n", nbits);
+      return FAILURE;
+    }
+    // 从 start 开始查找，找不到时回绕
+    unsigned int start = rand() % BENCH_BITS;
+    int next = -1;
+    for (unsigned int n = 0; n < nbits && next < 0; n++) {
+      unsigned int bit = (start % nbits + n) % nbits;
+      if (!(bitmap[bit / 8] & (0x80 >> (bit % 8)))) {
+        next = bit;
+      }
+    }
+    if (start >= nbits) {
+      next = expect;
+    }
+    if (findNextZeroBit(bitmap, start, nbits) != next) {
+      printf("mismatch with start %u nbits %u\n", start, nbits);
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+/**
+ * @brief 比较逐字节 getOffset、按字扫描和 AVX2 三种空闲位查找的耗时
+ *
+ * 位图大小为一个 4096 字节的块，唯一的 0 位依次放在不同位置。最后把
+ * 位图逐位分配满，比较从头查找和 next-fit 每次分配的平均耗时
+ */
+int main() {
+  if (checkRandom() == FAILURE) {
+    return 1;
+  }
+  printf("AVX2 available: %s\n", bitmapHasAvx2() ? "yes" : "no");
+  printf("%-12s %12s %12s %12s\n", "free bit", "getOffset", "word",
+         "avx2");
+
+  BYTE bitmap[BENCH_BITMAP_BYTES];
+  unsigned int positions[] = {0, BENCH_BITS / 4, BENCH_BITS / 2,
+                              BENCH_BITS - 1};
+  for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); i++) {
+    memset(bitmap, 0xff, sizeof(bitmap));
+    setBit(bitmap, positions[i], 0);
+    int expect = positions[i];
+    double byte_ns = measure(byteScan, bitmap, expect);
+    double word_ns = measure(findFirstZeroBitScalar, bitmap, expect);
+    double avx2_ns = bitmapHasAvx2()
+                         ? measure(findFirstZeroBitAvx2, bitmap, expect)
+                         : 0;
+    printf("%-12u %9.1f ns %9.1f ns %9.1f ns\n", positions[i], byte_ns,
+           word_ns, avx2_ns);
+  }
+
+  // 把整个位图逐位分配满，比较每次从头查找和从上次位置继续查找
+  struct timespec start, end;
+  memset(bitmap, 0, sizeof(bitmap));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCH_BITS; i++) {
+    setBit(bitmap, findFirstZeroBit(bitmap, BENCH_BITS), 1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double first_fit = elapsedNs(&start, &end) / BENCH_BITS;
+  memset(bitmap, 0, sizeof(bitmap));
+  unsigned int cursor = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCH_BITS; i++) {
+    int bit = findNextZeroBit(bitmap, cursor, BENCH_BITS);
+    setBit(bitmap, bit, 1);
+    cursor = bit + 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double next_fit = elapsedNs(&start, &end) / BENCH_BITS;
+  printf("\nfill %d bits: first-fit %.1f ns/alloc, next-fit %.1f ns/alloc\n",
+         BENCH_BITS, first_fit, next_fit);
+  return 0;
+}
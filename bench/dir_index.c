@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "disk.h"
+#include "ext2.h"
+
+#define BENCH_BLOCK_SIZE 4096
+// 每个组最多 32768 个 inode，5 个组放得下 10 万个文件
+#define BENCH_DISK_SIZE (640ULL << 20)
+#define BENCH_INODE_RATIO 4096
+#define BENCH_CACHE_BLOCKS 1024
+#define BENCH_DEFAULT_ENTRIES 100000
+// 线性查找的总开销是平方级的，只跑较少的目录项作为对照
+#define BENCH_DEFAULT_LINEAR 10000
+
+static double elapsedMs(struct timespec* start, struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1e3 +
+         (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/**
+ * @brief 在同一个目录中新建 entries 个文件，再逐个查找
+ *
+ * @return int 有文件没有建出来或找不到时返回 FAILURE
+ */
+static int run(const char* path, unsigned int entries, UINT32 compat) {
+  Disk disk;
+  if (makeDisk(&disk, path, BENCH_DISK_SIZE) == FAILURE) {
+    return FAILURE;
+  }
+  ext2Format(&disk, BENCH_BLOCK_SIZE, BENCH_INODE_RATIO, 0, compat);
+  closeDisk(&disk);
+
+  Ext2FileSystem file_system;
+  Ext2Inode current;
+  Ext2MountOptions options;
+  options.cache_blocks = BENCH_CACHE_BLOCKS;
+  options.write_back = 1;
+  options.backend = DISK_BACKEND_PREAD;
+  file_system.disk = NULL;
+  if (ext2Mount(&file_system, &current, (char*)path, &options) == FAILURE) {
+    return FAILURE;
+  }
+
+  char name[DIR_NAME_LEN];
+  struct timespec start, end;
+  int result = SUCCESS;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < entries && result == SUCCESS; i++) {
+    snprintf(name, sizeof(name), "f%07u", i);
+    result = ext2Touch(&file_system, &current, name);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double create_ms = elapsedMs(&start, &end);
+
+  // 按与创建不同的顺序查找，避免总是命中最近写过的目录块
+  Ext2DirEntry entry;
+  unsigned int index;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < entries && result == SUCCESS; i++) {
+    snprintf(name, sizeof(name), "f%07u", (unsigned int)((i * 7919ULL) %
+                                                         entries));
+    result = findDirEntry(file_system.disk, file_system.cwd, &current, name,
+                          &entry, &index);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double lookup_ms = elapsedMs(&start, &end);
+
+  if (result == FAILURE) {
+    printf("failed at \"%s\"\n", name);
+  } else {
+    printf("%-10s %7u entries: create %9.1f ms (%7.2f us/op), "
+           "lookup %9.1f ms (%7.2f us/op)\n",
+           compat & EXT2_FEATURE_COMPAT_DIR_INDEX ? "dir_index" : "linear",
+           entries, create_ms, create_ms * 1e3 / entries, lookup_ms,
+           lookup_ms * 1e3 / entries);
+  }
+  ext2Umount(&file_system);
+  free(file_system.disk);
+  unlink(path);
+  return result;
+}
+
+/**
+ * @brief 比较线性目录和带哈希索引的目录在大目录中新建和查找文件的开销
+ *
+ * 用法: bench_dir_index [entries] [linear-entries] [path]
+ */
+int main(int argc, char* argv[]) {
+  unsigned int entries =
+      argc > 1 ? (unsigned int)atoi(argv[1]) : BENCH_DEFAULT_ENTRIES;
+  unsigned int linear =
+      argc > 2 ? (unsigned int)atoi(argv[2]) : BENCH_DEFAULT_LINEAR;
+  const char* path = argc > 3 ? argv[3] : "dir_index.img";
+  if (linear > entries) {
+    linear = entries;
+  }
+  if (entries == 0) {
+    printf("usage: bench_dir_index [entries] [linear-entries] [path]\n");
+    return 1;
+  }
+
+  if (linear > 0 && run(path, linear, 0) == FAILURE) {
+    return 1;
+  }
+  if (run(path, linear, EXT2_FEATURE_COMPAT_DIR_INDEX) == FAILURE ||
+      run(path, entries, EXT2_FEATURE_COMPAT_DIR_INDEX) == FAILURE) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "disk.h"
+#include "ext2.h"
+
+#define BENCH_BLOCK_SIZE 4096
+// 只需要一个文件，inode 表尽量小
+#define BENCH_INODE_RATIO (1 << 20)
+#define BENCH_CACHE_BLOCKS 1024
+// 文件大小不按块对齐，最后一块只写了一部分
+#define BENCH_DEFAULT_SIZE ((5ULL << 30) + 1000)
+// 镜像在文件之外留出的空间，放各组的元数据和索引块
+#define BENCH_SLACK (512ULL << 20)
+// 每次追加的大小也不按块对齐，每次都要续写上一次的最后一块
+#define BENCH_CHUNK ((1 << 20) + 512)
+#define BENCH_FILE "large"
+
+static UINT64 scratch[BENCH_CHUNK / sizeof(UINT64) + 2];
+
+// 文件中每 8 个字节的内容是它在文件中的序号，读回时可以逐字节校验
+static void fillRange(BYTE* data, UINT64 offset, UINT32 size) {
+  UINT64 base = offset / sizeof(UINT64);
+  UINT32 words = (UINT32)((offset + size + 7) / sizeof(UINT64) - base);
+  for (UINT32 i = 0; i < words; i++) {
+    scratch[i] = base + i;
+  }
+  memcpy(data, (BYTE*)scratch + offset % sizeof(UINT64), size);
+}
+
+static double elapsedMs(struct timespec* start, struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1e3 +
+         (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int mountImage(Ext2FileSystem* file_system,
+                      Ext2Inode* current,
+                      const char* path) {
+  Ext2MountOptions options;
+  options.cache_blocks = BENCH_CACHE_BLOCKS;
+  options.write_back = 1;
+  options.backend = DISK_BACKEND_PREAD;
+  file_system->disk = NULL;
+  return ext2Mount(file_system, current, (char*)path, &options);
+}
+
+static void umountImage(Ext2FileSystem* file_system) {
+  ext2Umount(file_system);
+  free(file_system->disk);
+}
+
+// 读出 [offset, offset + size) 并与写入的内容比较
+static int verifyRange(Ext2FileSystem* file_system,
+                       Ext2Inode* current,
+                       UINT64 offset,
+                       UINT32 size,
+                       BYTE* data,
+                       BYTE* expect) {
+  UINT32 got;
+  if (ext2ReadAt(file_system, current, BENCH_FILE, offset, data, size, &got) ==
+          FAILURE ||
+      got != size) {
+    printf("short read at offset %llu\n", offset);
+    return FAILURE;
+  }
+  fillRange(expect, offset, size);
+  if (memcmp(expect, data, size) != 0) {
+    printf("data mismatch in [%llu, %llu)\n", offset, offset + size);
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+/**
+ * @brief 在超过 4 GiB 的镜像上建立文件系统，分批追加写入一个超过 4 GiB 的
+ * 文件，重新挂载后检查文件大小并逐段读回校验
+ *
+ * 使用 4096 字节的块时，间接索引的文件超过约 4 GiB 后开始用到三级索引
+ *
+ * 用法: bench_large_file [path] [size] [extents]
+ */
+int main(int argc, char* argv[]) {
+  const char* path = argc > 1 ? argv[1] : "large.img";
+  UINT64 file_size = argc > 2 ? strtoull(argv[2], NULL, 0) : BENCH_DEFAULT_SIZE;
+  int extents = argc > 3 ? atoi(argv[3]) : 0;
+
+  Disk disk;
+  if (makeDisk(&disk, path, file_size + BENCH_SLACK) == FAILURE) {
+    return 1;
+  }
+  int result = ext2Format(&disk, BENCH_BLOCK_SIZE, BENCH_INODE_RATIO,
+                          extents ? EXT2_FEATURE_INCOMPAT_EXTENTS : 0,
+                          0) == FAILURE;
+  closeDisk(&disk);
+  if (result != 0) {
+    unlink(path);
+    return 1;
+  }
+
+  BYTE* data = (BYTE*)malloc(BENCH_CHUNK);
+  BYTE* expect = (BYTE*)malloc(BENCH_CHUNK);
+  Ext2FileSystem file_system;
+  Ext2Inode current;
+  struct timespec start, end;
+  if (mountImage(&file_system, &current, path) == FAILURE) {
+    result = 1;
+    goto out;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (UINT64 offset = 0; offset < file_size; offset += BENCH_CHUNK) {
+    UINT32 size = file_size - offset < BENCH_CHUNK
+                      ? (UINT32)(file_size - offset)
+                      : BENCH_CHUNK;
+    fillRange(data, offset, size);
+    if (ext2Append(&file_system, &current, BENCH_FILE, data, size) ==
+        FAILURE) {
+      printf("append failed at offset %llu\n", offset);
+      result = 1;
+      break;
+    }
+  }
+  umountImage(&file_system);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double write_ms = elapsedMs(&start, &end);
+  if (result != 0) {
+    goto out;
+  }
+
+  // 重新挂载，大小和数据都必须从磁盘上读出
+  if (mountImage(&file_system, &current, path) == FAILURE) {
+    result = 1;
+    goto out;
+  }
+  Ext2DirEntry entry;
+  unsigned int index;
+  Ext2Inode inode;
+  memset(&inode, 0, sizeof(Ext2Inode));
+  if (findDirEntry(file_system.disk, file_system.cwd, &current, BENCH_FILE,
+                   &entry, &index) == SUCCESS) {
+    getInode(file_system.disk, entry.inode, &inode);
+  }
+  if (getInodeSize(&inode) != file_size) {
+    printf("inode size mismatch: %llu != %llu\n", getInodeSize(&inode),
+           file_size);
+    result = 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (UINT64 offset = 0; offset < file_size && result == 0;
+       offset += BENCH_CHUNK) {
+    UINT32 size = file_size - offset < BENCH_CHUNK
+                      ? (UINT32)(file_size - offset)
+                      : BENCH_CHUNK;
+    result = verifyRange(&file_system, &current, offset, size, data,
+                         expect) == FAILURE;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double read_ms = elapsedMs(&start, &end);
+  // 再读一段跨过 4 GiB 的数据，首尾都不在块边界上
+  if (result == 0 && file_size > (4ULL << 30) + BENCH_BLOCK_SIZE) {
+    result = verifyRange(&file_system, &current,
+                         (4ULL << 30) - BENCH_BLOCK_SIZE - 100,
+                         2 * BENCH_BLOCK_SIZE + 200, data, expect) == FAILURE;
+  }
+  umountImage(&file_system);
+
+  if (result == 0) {
+    double mib = (double)file_size / (1 << 20);
+    printf("file size:  %llu bytes (%s)\n", file_size,
+           extents ? "extents" : "indirect");
+    printf("write:      %.1f ms, %.1f MiB/s\n", write_ms, mib / write_ms * 1e3);
+    printf("read:       %.1f ms, %.1f MiB/s\n", read_ms, mib / read_ms * 1e3);
+  }
+
+out:
+  free(expect);
+  free(data);
+  unlink(path);
+  return result;
+}
@@ -0,0 +1,168 @@
+#include "bitmap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BITMAP_X86 1
+#endif
+
+// 以大端序读出 8 个字节，使第 0 位落在字的最高位
+static inline UINT64 loadWord(const BYTE* bytes) {
+  UINT64 word;
+  memcpy(&word, bytes, sizeof(UINT64));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+// 从第 first 个字开始扫描，words 为字的总数
+static inline int scanWords(const BYTE* bitmap,
+                            unsigned int first,
+                            unsigned int words,
+                            unsigned int nbits) {
+  for (unsigned int i = first; i < words; i++) {
+    UINT64 free_bits = ~loadWord(bitmap + i * 8);
+    if (free_bits != 0) {
+      unsigned int bit = i * 64 + __builtin_clzll(free_bits);
+      return bit < nbits ? (int)bit : -1;
+    }
+  }
+  return -1;
+}
+
+int findFirstZeroBitScalar(const BYTE* bitmap, unsigned int nbits) {
+  return scanWords(bitmap, 0, (nbits + 63) / 64, nbits);
+}
+
+#ifdef BITMAP_X86
+__attribute__((target("avx2"))) int findFirstZeroBitAvx2(const BYTE* bitmap,
+                                                         unsigned int nbits) {
+  unsigned int words = (nbits + 63) / 64;
+  unsigned int chunks = words / 4;
+  const __m256i ones = _mm256_set1_epi8((char)0xff);
+  for (unsigned int i = 0; i < chunks; i++) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i*)(bitmap + i * 32));
+    // 32 个字节都等于 0xff 时掩码为全 1，整块跳过
+    unsigned int full =
+        (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, ones));
+    if (full != 0xffffffffu) {
+      return scanWords(bitmap, i * 4, i * 4 + 4, nbits);
+    }
+  }
+  // 不足 32 字节的尾部按字扫描
+  return scanWords(bitmap, chunks * 4, words, nbits);
+}
+#else
+int findFirstZeroBitAvx2(const BYTE* bitmap, unsigned int nbits) {
+  return findFirstZeroBitScalar(bitmap, nbits);
+}
+#endif
+
+int bitmapHasAvx2() {
+  static int has_avx2 = -1;
+  if (has_avx2 < 0) {
+#ifdef BITMAP_X86
+    __builtin_cpu_init();
+    has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+    has_avx2 = 0;
+#endif
+  }
+  return has_avx2;
+}
+
+int findFirstZeroBit(const BYTE* bitmap, unsigned int nbits) {
+  if (bitmapHasAvx2()) {
+    return findFirstZeroBitAvx2(bitmap, nbits);
+  }
+  return findFirstZeroBitScalar(bitmap, nbits);
+}
+
+// 在 [start, nbits) 中查找第一个为 0 的位，不回绕
+static int findZeroFrom(const BYTE* bitmap,
+                        unsigned int start,
+                        unsigned int nbits) {
+  if (start >= nbits) {
+    return -1;
+  }
+  // start 所在的字先屏蔽掉 start 之前的位
+  unsigned int word_idx = start / 64;
+  UINT64 free_bits =
+      ~loadWord(bitmap + word_idx * 8) & (~0ULL >> (start % 64));
+  if (free_bits != 0) {
+    unsigned int bit = word_idx * 64 + __builtin_clzll(free_bits);
+    return bit < nbits ? (int)bit : -1;
+  }
+  // 之后的字从字边界开始，可以继续使用 findFirstZeroBit
+  unsigned int base = (word_idx + 1) * 64;
+  if (base >= nbits) {
+    return -1;
+  }
+  int bit = findFirstZeroBit(bitmap + base / 8, nbits - base);
+  return bit < 0 ? -1 : (int)base + bit;
+}
+
+int findNextZeroBit(const BYTE* bitmap,
+                    unsigned int start,
+                    unsigned int nbits) {
+  if (start >= nbits) {
+    start = 0;
+  }
+  int bit = findZeroFrom(bitmap, start, nbits);
+  // 回绕到开头查找 start 之前的部分
+  if (bit < 0 && start > 0) {
+    bit = findFirstZeroBit(bitmap, start);
+  }
+  return bit;
+}
+
+unsigned int zeroRunLength(const BYTE* bitmap,
+                           unsigned int start,
+                           unsigned int nbits) {
+  unsigned int bit = start;
+  while (bit < nbits) {
+    // 左移后字的最高位就是当前位，遇到第一个 1 即为连续段的结尾
+    UINT64 used = loadWord(bitmap + bit / 64 * 8) << (bit % 64);
+    if (used != 0) {
+      bit += __builtin_clzll(used);
+      break;
+    }
+    bit += 64 - bit % 64;
+  }
+  return (bit < nbits ? bit : nbits) - start;
+}
+
+int findZeroRun(const BYTE* bitmap,
+                unsigned int start,
+                unsigned int nbits,
+                unsigned int count,
+                unsigned int* run) {
+  int best = -1;
+  unsigned int best_len = 0;
+  if (start >= nbits) {
+    start = 0;
+  }
+  // 先查找 start 之后的部分，再回绕查找 start 之前的部分，
+  // 找到长度为 count 的段就立即返回
+  unsigned int ranges[2][2] = {{start, nbits}, {0, start}};
+  for (int r = 0; r < 2 && best_len < count; r++) {
+    unsigned int pos = ranges[r][0];
+    while (best_len < count) {
+      int bit = findZeroFrom(bitmap, pos, ranges[r][1]);
+      if (bit < 0) {
+        break;
+      }
+      unsigned int len = zeroRunLength(bitmap, bit, nbits);
+      if (len > count) {
+        len = count;
+      }
+      if (len > best_len) {
+        best = bit;
+        best_len = len;
+      }
+      pos = bit + len;
+    }
+  }
+  *run = best_len;
+  return best;
+}
@@ -0,0 +1,75 @@
+#ifndef __BITMAP_H__
+#define __BITMAP_H__
+
+#include <string.h>
+
+#include "common.h"
+
+/*
+ * 位图按字节从高位到低位编号，第 i 位是 bitmap[i / 8] 的
+ * (0x80 >> (i % 8))，与 setBit/getOffset 一致
+ */
+
+/**
+ * @brief 在位图的前 nbits 位中找到第一个为 0 的位
+ *
+ * 按 64 位字扫描，跳过全 1 的字，再用 clz 直接得到字内的位置。支持 AVX2
+ * 的 CPU 上先以 32 字节为单位跳过全满的区域，运行时自动选择
+ *
+ * @param bitmap 位图，长度至少为 nbits 向上取整到 8 字节
+ * @param nbits 参与查找的位数
+ * @return int 第一个 0 的位置，没有时返回 -1
+ */
+int findFirstZeroBit(const BYTE* bitmap, unsigned int nbits);
+
+/**
+ * @brief 从第 start 位开始查找第一个为 0 的位，到 nbits 后回绕到开头
+ *
+ * @param bitmap 位图，长度要求同 findFirstZeroBit
+ * @param start 开始查找的位置，不小于 nbits 时从 0 开始
+ * @param nbits 参与查找的位数
+ * @return int 找到的位置，位图全满时返回 -1
+ */
+int findNextZeroBit(const BYTE* bitmap, unsigned int start,
+                    unsigned int nbits);
+
+/**
+ * @brief 从第 start 位开始连续为 0 的位数，start 本身为 1 时返回 0
+ *
+ * @param bitmap
+ * @param start
+ * @param nbits 位图的位数，连续段不会超过这里
+ * @return unsigned int
+ */
+unsigned int zeroRunLength(const BYTE* bitmap, unsigned int start,
+                           unsigned int nbits);
+
+/**
+ * @brief 从第 start 位开始查找一段连续的 0，长度不超过 count
+ *
+ * 按 findNextZeroBit 的顺序依次检查各个空闲段，遇到长度达到 count 的段立即
+ * 返回，否则返回其中最长的一段
+ *
+ * @param bitmap
+ * @param start 开始查找的位置
+ * @param nbits 参与查找的位数
+ * @param count 需要的长度
+ * @param run 返回找到的长度
+ * @return int 段的起始位置，位图全满时返回 -1
+ */
+int findZeroRun(const BYTE* bitmap, unsigned int start, unsigned int nbits,
+                unsigned int count, unsigned int* run);
+
+// 以下两个实现供基准程序对比，分配器只使用 findFirstZeroBit
+
+int findFirstZeroBitScalar(const BYTE* bitmap, unsigned int nbits);
+int findFirstZeroBitAvx2(const BYTE* bitmap, unsigned int nbits);
+
+/**
+ * @brief 当前 CPU 是否支持 AVX2，即 findFirstZeroBit 是否走 AVX2 路径
+ *
+ * @return int
+ */
+int bitmapHasAvx2();
+
+#endif  // __BITMAP_H__
@@ -0,0 +1,335 @@
+#include "cache.h"
+
+static unsigned int hashBlock(BlockCache* cache, unsigned int block_idx) {
+  // 乘法哈希，hash_size 为 2 的幂
+  return (block_idx * 2654435761u) & (cache->hash_size - 1);
+}
+
+static int lookupEntry(BlockCache* cache, unsigned int block_idx) {
+  int i = cache->buckets[hashBlock(cache, block_idx)];
+  while (i != -1) {
+    if (cache->entries[i].block_idx == block_idx) {
+      return i;
+    }
+    i = cache->entries[i].hash_next;
+  }
+  return -1;
+}
+
+static void unlinkHash(BlockCache* cache, int i) {
+  int* p = &cache->buckets[hashBlock(cache, cache->entries[i].block_idx)];
+  while (*p != -1) {
+    if (*p == i) {
+      *p = cache->entries[i].hash_next;
+      return;
+    }
+    p = &cache->entries[*p].hash_next;
+  }
+}
+
+static void unlinkLru(BlockCache* cache, int i) {
+  CacheEntry* e = &cache->entries[i];
+  if (e->lru_prev != -1) {
+    cache->entries[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    cache->lru_head = e->lru_next;
+  }
+  if (e->lru_next != -1) {
+    cache->entries[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    cache->lru_tail = e->lru_prev;
+  }
+}
+
+static void pushLruHead(BlockCache* cache, int i) {
+  CacheEntry* e = &cache->entries[i];
+  e->lru_prev = -1;
+  e->lru_next = cache->lru_head;
+  if (cache->lru_head != -1) {
+    cache->entries[cache->lru_head].lru_prev = i;
+  }
+  cache->lru_head = i;
+  if (cache->lru_tail == -1) {
+    cache->lru_tail = i;
+  }
+}
+
+static int compareBlockIdx(const void* a, const void* b) {
+  unsigned int x = (*(CacheEntry* const*)a)->block_idx;
+  unsigned int y = (*(CacheEntry* const*)b)->block_idx;
+  return (x > y) - (x < y);
+}
+
+// 取出最久未使用的表项，重新挂到 block_idx 对应的哈希链上。换出的脏块
+// 写回失败时返回 -1
+static int claimEntry(BlockCache* cache, Disk* disk, unsigned int block_idx) {
+  int i = cache->lru_tail;
+  CacheEntry* e = &cache->entries[i];
+  if (e->valid) {
+    if (e->dirty) {
+      // 被换出的脏块需要先写回，写回失败时保留脏块，不占用这个表项
+      if (disk->write_disk(disk, e->block_idx, e->data) == FAILURE) {
+        return -1;
+      }
+      cache->writes++;
+      e->dirty = 0;
+      cache->dirty_count--;
+    }
+    unlinkHash(cache, i);
+  }
+  e->block_idx = block_idx;
+  e->valid = 1;
+  unsigned int h = hashBlock(cache, block_idx);
+  e->hash_next = cache->buckets[h];
+  cache->buckets[h] = i;
+  return i;
+}
+
+static void touchEntry(BlockCache* cache, int i) {
+  if (cache->lru_head != i) {
+    unlinkLru(cache, i);
+    pushLruHead(cache, i);
+  }
+}
+
+BlockCache* createBlockCache(unsigned int capacity,
+                             unsigned int block_size,
+                             int write_back) {
+  if (capacity == 0) {
+    capacity = DEFAULT_CACHE_BLOCKS;
+  }
+  BlockCache* cache = (BlockCache*)malloc(sizeof(BlockCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+  cache->capacity = capacity;
+  cache->block_size = block_size;
+  cache->hash_size = 1;
+  while (cache->hash_size < capacity) {
+    cache->hash_size <<= 1;
+  }
+  cache->buckets = (int*)malloc(cache->hash_size * sizeof(int));
+  cache->entries = (CacheEntry*)malloc(capacity * sizeof(CacheEntry));
+  cache->pool = (BYTE*)malloc((size_t)capacity * block_size);
+  if (cache->buckets == NULL || cache->entries == NULL || cache->pool == NULL) {
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache->pool);
+    free(cache);
+    return NULL;
+  }
+  for (unsigned int i = 0; i < cache->hash_size; i++) {
+    cache->buckets[i] = -1;
+  }
+  cache->lru_head = -1;
+  cache->lru_tail = -1;
+  for (unsigned int i = 0; i < capacity; i++) {
+    cache->entries[i].valid = 0;
+    cache->entries[i].dirty = 0;
+    cache->entries[i].data = cache->pool + (size_t)i * block_size;
+    cache->entries[i].hash_next = -1;
+    pushLruHead(cache, i);
+  }
+  cache->write_back = write_back;
+  cache->dirty_count = 0;
+  cache->dirty_limit = capacity / 2 > 0 ? capacity / 2 : 1;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->writes = 0;
+  return cache;
+}
+
+void destroyBlockCache(BlockCache* cache) {
+  if (cache == NULL) {
+    return;
+  }
+  free(cache->buckets);
+  free(cache->entries);
+  free(cache->pool);
+  free(cache);
+}
+
+int cacheReadBlock(BlockCache* cache,
+                   Disk* disk,
+                   unsigned int block_idx,
+                   void* data) {
+  int i = lookupEntry(cache, block_idx);
+  if (i != -1) {
+    cache->hits++;
+    touchEntry(cache, i);
+    memcpy(data, cache->entries[i].data, cache->block_size);
+    return SUCCESS;
+  }
+  cache->misses++;
+  if (disk->read_disk(disk, block_idx, data) == FAILURE) {
+    return FAILURE;
+  }
+  i = claimEntry(cache, disk, block_idx);
+  if (i != -1) {
+    touchEntry(cache, i);
+    memcpy(cache->entries[i].data, data, cache->block_size);
+  }
+  return SUCCESS;
+}
+
+// 用 data 更新缓存中的副本，写回模式下标记为脏块。没有表项可用时，写回
+// 模式直接写磁盘，直写模式调用前已经写过
+static int updateEntry(BlockCache* cache,
+                       Disk* disk,
+                       unsigned int block_idx,
+                       void* data) {
+  int i = lookupEntry(cache, block_idx);
+  if (i == -1) {
+    i = claimEntry(cache, disk, block_idx);
+  }
+  if (i == -1) {
+    if (!cache->write_back) {
+      return SUCCESS;
+    }
+    if (disk->write_disk(disk, block_idx, data) == FAILURE) {
+      return FAILURE;
+    }
+    cache->writes++;
+    return SUCCESS;
+  }
+  touchEntry(cache, i);
+  memcpy(cache->entries[i].data, data, cache->block_size);
+  if (cache->write_back && !cache->entries[i].dirty) {
+    // 写回模式只记录脏块，同一块的多次修改只会写一次磁盘
+    cache->entries[i].dirty = 1;
+    cache->dirty_count++;
+  }
+  return SUCCESS;
+}
+
+int cacheWriteBlock(BlockCache* cache,
+                    Disk* disk,
+                    unsigned int block_idx,
+                    void* data) {
+  if (!cache->write_back) {
+    if (disk->write_disk(disk, block_idx, data) == FAILURE) {
+      return FAILURE;
+    }
+    cache->writes++;
+  }
+  if (updateEntry(cache, disk, block_idx, data) == FAILURE) {
+    return FAILURE;
+  }
+  if (cache->write_back && cache->dirty_count >= cache->dirty_limit) {
+    return flushBlockCache(cache, disk);
+  }
+  return SUCCESS;
+}
+
+int cacheReadBlocks(BlockCache* cache,
+                    Disk* disk,
+                    DiskRequest* requests,
+                    unsigned int count) {
+  DiskRequest* misses = (DiskRequest*)malloc(count * sizeof(DiskRequest));
+  if (misses == NULL) {
+    return FAILURE;
+  }
+  unsigned int n = 0;
+  for (unsigned int k = 0; k < count; k++) {
+    int i = lookupEntry(cache, requests[k].block_idx);
+    if (i != -1) {
+      cache->hits++;
+      touchEntry(cache, i);
+      memcpy(requests[k].data, cache->entries[i].data, cache->block_size);
+    } else {
+      cache->misses++;
+      misses[n++] = requests[k];
+    }
+  }
+  int ret = SUCCESS;
+  if (n > 0 && (ret = disk->read_disk_v(disk, misses, n)) == SUCCESS) {
+    for (unsigned int k = 0; k < n; k++) {
+      // 同一块可能在 requests 中出现多次
+      int i = lookupEntry(cache, misses[k].block_idx);
+      if (i == -1) {
+        i = claimEntry(cache, disk, misses[k].block_idx);
+      }
+      if (i == -1) {
+        continue;
+      }
+      touchEntry(cache, i);
+      memcpy(cache->entries[i].data, misses[k].data, cache->block_size);
+    }
+  }
+  free(misses);
+  return ret;
+}
+
+int cacheWriteBlocks(BlockCache* cache,
+                     Disk* disk,
+                     DiskRequest* requests,
+                     unsigned int count) {
+  if (!cache->write_back) {
+    if (disk->write_disk_v(disk, requests, count) == FAILURE) {
+      return FAILURE;
+    }
+    cache->writes += count;
+  }
+  for (unsigned int k = 0; k < count; k++) {
+    if (updateEntry(cache, disk, requests[k].block_idx, requests[k].data) ==
+        FAILURE) {
+      return FAILURE;
+    }
+  }
+  if (cache->write_back && cache->dirty_count >= cache->dirty_limit) {
+    return flushBlockCache(cache, disk);
+  }
+  return SUCCESS;
+}
+
+int flushBlockCache(BlockCache* cache, Disk* disk) {
+  if (cache->dirty_count == 0) {
+    return SUCCESS;
+  }
+  CacheEntry** dirty =
+      (CacheEntry**)malloc(cache->dirty_count * sizeof(CacheEntry*));
+  if (dirty == NULL) {
+    return FAILURE;
+  }
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < cache->capacity; i++) {
+    if (cache->entries[i].valid && cache->entries[i].dirty) {
+      dirty[n++] = &cache->entries[i];
+    }
+  }
+  // 按块号升序写回，相邻的脏块合并成一次批量写
+  qsort(dirty, n, sizeof(CacheEntry*), compareBlockIdx);
+  DiskRequest* requests = (DiskRequest*)malloc(n * sizeof(DiskRequest));
+  if (requests == NULL) {
+    free(dirty);
+    return FAILURE;
+  }
+  for (unsigned int i = 0; i < n; i++) {
+    requests[i].block_idx = dirty[i]->block_idx;
+    requests[i].data = dirty[i]->data;
+  }
+  int ret = disk->write_disk_v(disk, requests, n);
+  if (ret == SUCCESS) {
+    for (unsigned int i = 0; i < n; i++) {
+      dirty[i]->dirty = 0;
+    }
+    cache->writes += n;
+    cache->dirty_count = 0;
+  }
+  free(requests);
+  free(dirty);
+  return ret;
+}
+
+void printCacheInfo(BlockCache* cache) {
+  unsigned long long total = cache->hits + cache->misses;
+  printf("Cache Info:\n");
+  printf("    Mode: %s\n", cache->write_back ? "write-back" : "write-through");
+  printf("    Capacity: %u blocks\n", cache->capacity);
+  printf("    Hits: %llu\n", cache->hits);
+  printf("    Misses: %llu\n", cache->misses);
+  printf("    Hit Rate: %.2f%%\n",
+         total == 0 ? 0.0 : 100.0 * cache->hits / total);
+  printf("    Dirty Blocks: %u\n", cache->dirty_count);
+  printf("    Disk Writes: %llu\n", cache->writes);
+}
@@ -0,0 +1,131 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+
+#define DEFAULT_CACHE_BLOCKS 256
+
+/**
+ * @brief 缓存中的一个块，同时挂在哈希链和 LRU 链表上
+ *
+ */
+typedef struct CacheEntry {
+  unsigned int block_idx;  // 缓存的块号
+  int valid;               // 是否存放了有效数据
+  int dirty;               // 是否有尚未写回磁盘的修改
+  int hash_next;           // 哈希链中的下一个表项，-1 表示结束
+  int lru_prev;            // LRU 链表中更新的一项
+  int lru_next;            // LRU 链表中更旧的一项
+  BYTE* data;              // 块数据，指向缓存的数据区
+} CacheEntry;
+
+/**
+ * @brief 块缓存，位于 readBlock/writeBlock 与 Disk 之间
+ *
+ */
+typedef struct BlockCache {
+  unsigned int capacity;      // 最多缓存的块数
+  unsigned int block_size;    // 块大小
+  BYTE* pool;                 // 所有表项的数据区
+  unsigned int hash_size;     // 哈希桶个数，2 的幂
+  int* buckets;               // 哈希桶，存放表项下标
+  CacheEntry* entries;        // 表项数组
+  int lru_head;               // 最近使用的表项
+  int lru_tail;               // 最久未使用的表项
+  int write_back;             // 是否为写回模式
+  unsigned int dirty_count;   // 脏块个数
+  unsigned int dirty_limit;   // 脏块达到该数量时自动写回
+  unsigned long long hits;    // 命中次数
+  unsigned long long misses;  // 未命中次数
+  unsigned long long writes;  // 实际写入磁盘的块数
+} BlockCache;
+
+/**
+ * @brief 创建一个容量为 capacity 块的缓存
+ *
+ * @param capacity 缓存块数，为 0 时使用 DEFAULT_CACHE_BLOCKS
+ * @param block_size 块大小
+ * @param write_back 为 1 时写操作只标记脏块，由 flushBlockCache 统一写回
+ * @return BlockCache* 失败返回 NULL
+ */
+BlockCache* createBlockCache(unsigned int capacity, unsigned int block_size,
+                             int write_back);
+
+/**
+ * @brief 释放缓存占用的内存
+ *
+ * @param cache
+ */
+void destroyBlockCache(BlockCache* cache);
+
+/**
+ * @brief 通过缓存读取 disk 的第 block_idx 个块，未命中时从 disk 读入
+ *
+ * @param cache
+ * @param disk
+ * @param block_idx
+ * @param data
+ * @return int
+ */
+int cacheReadBlock(BlockCache* cache, Disk* disk, unsigned int block_idx,
+                   void* data);
+
+/**
+ * @brief 写入 disk 的第 block_idx 个块，并更新缓存中的副本。写回模式下只
+ * 标记为脏块，脏块数达到 dirty_limit 时整体写回
+ *
+ * @param cache
+ * @param disk
+ * @param block_idx
+ * @param data
+ * @return int
+ */
+int cacheWriteBlock(BlockCache* cache, Disk* disk, unsigned int block_idx,
+                    void* data);
+
+/**
+ * @brief 通过缓存批量读取块，未命中的块合并成一次批量读
+ *
+ * @param cache
+ * @param disk
+ * @param requests
+ * @param count
+ * @return int
+ */
+int cacheReadBlocks(BlockCache* cache, Disk* disk, DiskRequest* requests,
+                    unsigned int count);
+
+/**
+ * @brief 通过缓存批量写入块，写直达模式下合并成一次批量写
+ *
+ * @param cache
+ * @param disk
+ * @param requests
+ * @param count
+ * @return int
+ */
+int cacheWriteBlocks(BlockCache* cache, Disk* disk, DiskRequest* requests,
+                     unsigned int count);
+
+/**
+ * @brief 将所有脏块按块号升序写回 disk，相邻的块合并成一次批量写
+ *
+ * @param cache
+ * @param disk
+ * @return int
+ */
+int flushBlockCache(BlockCache* cache, Disk* disk);
+
+/**
+ * @brief 输出缓存的命中统计
+ *
+ * @param cache
+ */
+void printCacheInfo(BlockCache* cache);
+
+#endif  // __CACHE_H__
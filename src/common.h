@@ -13,19 +13,53 @@
 #define EXT2_DIR 0x0001
 
 #define EXT2_N_BLOCKS 8
+// block 数组中直接索引的个数，之后是一级和二级索引。三级索引的根不在
+// block 数组中，存放在 inode 的 tind_block，EXT2_TIND_BLOCK 只用作编号
+#define EXT2_NDIR_BLOCKS 6
+#define EXT2_IND_BLOCK EXT2_NDIR_BLOCKS
+#define EXT2_DIND_BLOCK (EXT2_IND_BLOCK + 1)
+#define EXT2_TIND_BLOCK (EXT2_DIND_BLOCK + 1)
+
+// 映射缓存中同时保留的索引块个数，三级索引的一条路径占 3 个
+#define EXT2_MAP_CACHE_SLOTS 8
+// 按文件哈希的已解析映射的槽位数，2 的幂
+#define EXT2_MAP_RUN_SLOTS 64
+
+// 超级块 feature_incompat 中的特性，不认识其中任一位的实现不能挂载
+#define EXT2_FEATURE_INCOMPAT_EXTENTS 0x0040
+#define EXT2_FEATURE_INCOMPAT_SUPP EXT2_FEATURE_INCOMPAT_EXTENTS
+// inode flags 中的标志，block 数组存放的是 extent 树的根节点
+#define EXT2_EXTENTS_FL 0x00080000
+
+// 超级块 feature_compat 中的特性，不认识的实现可以忽略，目录项仍是线性排列
+#define EXT2_FEATURE_COMPAT_DIR_INDEX 0x0020
+// inode flags 中的标志，目录带有哈希索引，索引文件的 inode 序号存放在 file_acl
+#define EXT2_INDEX_FL 0x00001000
+
+// 文件增长时在最后一块之后预留的块数，以及同时保留的窗口个数
+#define EXT2_PREALLOC_BLOCKS 8
+#define EXT2_PREALLOC_SLOTS 16
+
+// 同时缓存在内存中、尚未分配块的文件个数
+#define EXT2_DELAYED_SLOTS 16
 
 #define DIR_NAME_LEN 15
+// 目录迭代器一次批量读入的目录块数
+#define EXT2_DIR_ITER_BLOCKS 4
+// 路径的最大长度，包括结尾的 '\0'
+#define EXT2_PATH_MAX 256
+// 路径前缀缓存中同时保留的目录个数
+#define EXT2_PATH_CACHE_SLOTS 8
 
 #define LINUX 0xEF53
 
+// 以下位置都属于 0 号组。组描述符表从 GDT_BLOCK_BASE 开始，占用的块数由
+// 组数决定，0 号组的元数据紧跟在它之后；其余组的元数据从组的第一个块开始
 #define DISK_BOOT_BASE 0
 #define SUPER_BLOCK_BASE (DISK_BOOT_BASE + 0)
 #define GDT_BLOCK_BASE (SUPER_BLOCK_BASE + 1)
-#define INODE_BITMAP_BASE (GDT_BLOCK_BASE + 1)
-#define BLOCK_BITMAP_BASE (INODE_BITMAP_BASE + 1)
-#define INODE_TABLE_BASE (BLOCK_BITMAP_BASE + 1)
-#define DATA_BLOCK_BASE (INODE_TABLE_BASE + INODE_TABLE_BLOCKS)
 
+typedef unsigned long long UINT64;
 typedef unsigned int UINT32;
 typedef unsigned short UINT16;
 typedef unsigned char BYTE;
@@ -33,19 +67,20 @@ typedef unsigned char BYTE;
 #define DIR_TYPE 2
 #define FILE_TYPE 1
 
-#define SECTORS_PRE_BLOCK 1
-#define INODES_PER_BLOCK (BLOCK_SIZE / INODE_SIZE)
-#define DIRS_PER_BLOCK (BLOCK_SIZE / DIR_SIZE)
-
 #define SECTOR_SIZE 512
-#define BLOCK_SIZE (SECTOR_SIZE * SECTORS_PRE_BLOCK)
 #define INODE_SIZE 128
-#define INODE_TABLE_BLOCKS (NUMBER_OF_INODES / INODES_PER_BLOCK)
 #define DIR_SIZE 32
 #define SUPER_BLOCK_SIZE 512
 #define GD_SIZE 32
 
-#define NUMBER_OF_BLOCKS 4096
-#define NUMBER_OF_INODES (NUMBER_OF_BLOCKS / 4)
+// 块大小在 format 时选择并记录在超级块中
+// 块大小 = SECTOR_SIZE << log_block_size
+#define MIN_BLOCK_SIZE SECTOR_SIZE
+#define MAX_BLOCK_SIZE 4096
+#define DEFAULT_BLOCK_SIZE 512
+// mkdsk 默认的磁盘大小 (byte)
+#define DEFAULT_DISK_SIZE (4096 * 512)
+// 每多少字节的磁盘空间分配一个 inode
+#define DEFAULT_INODE_RATIO 2048
 
 #endif  // __COMMON_H__
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "dcache.h"
+
+#include "dirindex.h"
+
+static unsigned int hashDentry(DentryCache* cache,
+                               unsigned int parent,
+                               const char* name) {
+  return (dirNameHash(name) ^ (parent * 2654435761u)) & (cache->hash_size - 1);
+}
+
+static int lookupEntry(DentryCache* cache,
+                       unsigned int parent,
+                       const char* name) {
+  int i = cache->buckets[hashDentry(cache, parent, name)];
+  while (i != -1) {
+    DentryCacheEntry* e = &cache->entries[i];
+    if (e->parent == parent && !strcmp(e->name, name)) {
+      return i;
+    }
+    i = e->hash_next;
+  }
+  return -1;
+}
+
+static void unlinkHash(DentryCache* cache, int i) {
+  DentryCacheEntry* e = &cache->entries[i];
+  int* p = &cache->buckets[hashDentry(cache, e->parent, e->name)];
+  while (*p != -1) {
+    if (*p == i) {
+      *p = e->hash_next;
+      return;
+    }
+    p = &cache->entries[*p].hash_next;
+  }
+}
+
+static void unlinkLru(DentryCache* cache, int i) {
+  DentryCacheEntry* e = &cache->entries[i];
+  if (e->lru_prev != -1) {
+    cache->entries[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    cache->lru_head = e->lru_next;
+  }
+  if (e->lru_next != -1) {
+    cache->entries[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    cache->lru_tail = e->lru_prev;
+  }
+}
+
+static void pushLruHead(DentryCache* cache, int i) {
+  DentryCacheEntry* e = &cache->entries[i];
+  e->lru_prev = -1;
+  e->lru_next = cache->lru_head;
+  if (cache->lru_head != -1) {
+    cache->entries[cache->lru_head].lru_prev = i;
+  }
+  cache->lru_head = i;
+  if (cache->lru_tail == -1) {
+    cache->lru_tail = i;
+  }
+}
+
+static void pushLruTail(DentryCache* cache, int i) {
+  DentryCacheEntry* e = &cache->entries[i];
+  e->lru_next = -1;
+  e->lru_prev = cache->lru_tail;
+  if (cache->lru_tail != -1) {
+    cache->entries[cache->lru_tail].lru_next = i;
+  }
+  cache->lru_tail = i;
+  if (cache->lru_head == -1) {
+    cache->lru_head = i;
+  }
+}
+
+static void touchEntry(DentryCache* cache, int i) {
+  if (cache->lru_head != i) {
+    unlinkLru(cache, i);
+    pushLruHead(cache, i);
+  }
+}
+
+DentryCache* createDentryCache(unsigned int capacity) {
+  if (capacity == 0) {
+    capacity = DEFAULT_DENTRY_CACHE;
+  }
+  DentryCache* cache = (DentryCache*)malloc(sizeof(DentryCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+  cache->capacity = capacity;
+  cache->hash_size = 1;
+  while (cache->hash_size < capacity) {
+    cache->hash_size <<= 1;
+  }
+  cache->buckets = (int*)malloc(cache->hash_size * sizeof(int));
+  cache->entries =
+      (DentryCacheEntry*)malloc(capacity * sizeof(DentryCacheEntry));
+  if (cache->buckets == NULL || cache->entries == NULL) {
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache);
+    return NULL;
+  }
+  for (unsigned int i = 0; i < cache->hash_size; i++) {
+    cache->buckets[i] = -1;
+  }
+  cache->lru_head = -1;
+  cache->lru_tail = -1;
+  for (unsigned int i = 0; i < capacity; i++) {
+    cache->entries[i].valid = 0;
+    cache->entries[i].hash_next = -1;
+    pushLruHead(cache, i);
+  }
+  cache->hits = 0;
+  cache->negative_hits = 0;
+  cache->misses = 0;
+  return cache;
+}
+
+void destroyDentryCache(DentryCache* cache) {
+  if (cache == NULL) {
+    return;
+  }
+  free(cache->buckets);
+  free(cache->entries);
+  free(cache);
+}
+
+int lookupDentry(DentryCache* cache,
+                 unsigned int parent,
+                 const char* name,
+                 Ext2DirEntry* entry,
+                 unsigned int* index) {
+  int i = lookupEntry(cache, parent, name);
+  if (i == -1) {
+    cache->misses++;
+    return DENTRY_MISS;
+  }
+  touchEntry(cache, i);
+  DentryCacheEntry* e = &cache->entries[i];
+  if (e->negative) {
+    cache->negative_hits++;
+    return DENTRY_NEGATIVE;
+  }
+  cache->hits++;
+  memcpy(entry, &e->entry, DIR_SIZE);
+  *index = e->index;
+  return DENTRY_FOUND;
+}
+
+void addDentry(DentryCache* cache,
+               unsigned int parent,
+               const char* name,
+               Ext2DirEntry* entry,
+               unsigned int index) {
+  if (strlen(name) >= DIR_NAME_LEN) {
+    // 放不进目录项的文件名不可能存在，也不需要记住
+    return;
+  }
+  int i = lookupEntry(cache, parent, name);
+  if (i == -1) {
+    // 换出最久未使用的表项，重新挂到新的哈希链上
+    i = cache->lru_tail;
+    DentryCacheEntry* e = &cache->entries[i];
+    if (e->valid) {
+      unlinkHash(cache, i);
+    }
+    e->parent = parent;
+    strcpy(e->name, name);
+    e->valid = 1;
+    unsigned int h = hashDentry(cache, parent, name);
+    e->hash_next = cache->buckets[h];
+    cache->buckets[h] = i;
+  }
+  touchEntry(cache, i);
+  DentryCacheEntry* e = &cache->entries[i];
+  e->negative = entry == NULL;
+  e->index = index;
+  if (entry != NULL) {
+    memcpy(&e->entry, entry, DIR_SIZE);
+  }
+}
+
+void forgetDirDentries(DentryCache* cache, unsigned int parent) {
+  for (unsigned int i = 0; i < cache->capacity; i++) {
+    DentryCacheEntry* e = &cache->entries[i];
+    if (e->valid && e->parent == parent) {
+      // 空出的表项放到 LRU 尾部优先复用
+      unlinkHash(cache, i);
+      e->valid = 0;
+      unlinkLru(cache, i);
+      pushLruTail(cache, i);
+    }
+  }
+}
+
+void printDentryCacheInfo(DentryCache* cache) {
+  unsigned long long total = cache->hits + cache->negative_hits + cache->misses;
+  unsigned int negative = 0;
+  for (unsigned int i = 0; i < cache->capacity; i++) {
+    negative += cache->entries[i].valid && cache->entries[i].negative;
+  }
+  printf("Dentry Cache Info:\n");
+  printf("    Capacity: %u names\n", cache->capacity);
+  printf("    Negative Entries: %u\n", negative);
+  printf("    Hits: %llu\n", cache->hits);
+  printf("    Negative Hits: %llu\n", cache->negative_hits);
+  printf("    Misses: %llu\n", cache->misses);
+  printf("    Hit Rate: %.2f%%\n",
+         total == 0 ? 0.0
+                    : 100.0 * (cache->hits + cache->negative_hits) / total);
+}
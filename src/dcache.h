@@ -0,0 +1,108 @@
+#ifndef __DCACHE_H__
+#define __DCACHE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+#include "ext2.h"
+
+#define DEFAULT_DENTRY_CACHE 256
+
+// lookupDentry 的结果
+#define DENTRY_MISS 0      // 缓存中没有记录，需要查找目录
+#define DENTRY_FOUND 1     // 目录中有这个文件名
+#define DENTRY_NEGATIVE 2  // 目录中没有这个文件名
+
+/**
+ * @brief 缓存中的一个文件名，同时挂在哈希链和 LRU 链表上
+ *
+ */
+typedef struct DentryCacheEntry {
+  unsigned int parent;      // 所在目录的 inode 序号
+  char name[DIR_NAME_LEN];  // 文件名
+  int valid;                // 是否存放了有效数据
+  int negative;             // 为 1 时表示目录中没有这个文件名
+  unsigned int index;       // 目录项在目录中的序号
+  Ext2DirEntry entry;       // 目录项的副本
+  int hash_next;            // 哈希链中的下一个表项，-1 表示结束
+  int lru_prev;             // LRU 链表中更新的一项
+  int lru_next;             // LRU 链表中更旧的一项
+} DentryCacheEntry;
+
+/**
+ * @brief 目录项缓存，以 (目录 inode 序号, 文件名) 为键，同时记住不存在的
+ * 文件名，重复的查找和存在性检查不需要再读目录
+ *
+ */
+typedef struct DentryCache {
+  unsigned int capacity;             // 最多缓存的文件名数
+  unsigned int hash_size;            // 哈希桶个数，2 的幂
+  int* buckets;                      // 哈希桶，存放表项下标
+  DentryCacheEntry* entries;         // 表项数组
+  int lru_head;                      // 最近使用的表项
+  int lru_tail;                      // 最久未使用的表项
+  unsigned long long hits;           // 命中存在的文件名的次数
+  unsigned long long negative_hits;  // 命中不存在的文件名的次数
+  unsigned long long misses;         // 未命中次数
+} DentryCache;
+
+/**
+ * @brief 创建一个容量为 capacity 个文件名的缓存
+ *
+ * @param capacity 为 0 时使用 DEFAULT_DENTRY_CACHE
+ * @return DentryCache* 失败返回 NULL
+ */
+DentryCache* createDentryCache(unsigned int capacity);
+
+/**
+ * @brief 释放缓存占用的内存
+ *
+ * @param cache
+ */
+void destroyDentryCache(DentryCache* cache);
+
+/**
+ * @brief 查找目录 parent 中的文件名 name
+ *
+ * @param cache
+ * @param parent
+ * @param name
+ * @param entry 命中存在的文件名时返回目录项
+ * @param index 命中存在的文件名时返回目录项的序号
+ * @return int DENTRY_MISS、DENTRY_FOUND 或 DENTRY_NEGATIVE
+ */
+int lookupDentry(DentryCache* cache, unsigned int parent, const char* name,
+                 Ext2DirEntry* entry, unsigned int* index);
+
+/**
+ * @brief 记录目录 parent 中 name 的查找结果，已有的记录被覆盖
+ *
+ * @param cache
+ * @param parent
+ * @param name
+ * @param entry 为 NULL 时记录为不存在
+ * @param index
+ */
+void addDentry(DentryCache* cache, unsigned int parent, const char* name,
+               Ext2DirEntry* entry, unsigned int index);
+
+/**
+ * @brief 丢弃目录 parent 中所有文件名的记录，目录被删除时调用，
+ * 之后复用这个 inode 的目录不会看到旧的记录
+ *
+ * @param cache
+ * @param parent
+ */
+void forgetDirDentries(DentryCache* cache, unsigned int parent);
+
+/**
+ * @brief 输出缓存的命中统计
+ *
+ * @param cache
+ */
+void printDentryCacheInfo(DentryCache* cache);
+
+#endif  // __DCACHE_H__
@@ -0,0 +1,320 @@
+#include "dirindex.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+UINT32 dirNameHash(const char* name) {
+  UINT32 hash = FNV_OFFSET_BASIS;
+  for (const BYTE* p = (const BYTE*)name; *p != '\0'; p++) {
+    hash ^= *p;
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static UINT32 slotsPerBlock(Disk* disk) {
+  return disk->layout->block_size / sizeof(Ext2DirIndexSlot);
+}
+
+// 读入目录的索引文件和它的头部
+static int openIndex(Disk* disk,
+                     Ext2Inode* dir,
+                     Ext2Inode* index_inode,
+                     Ext2DirIndexHeader* header) {
+  BYTE block[MAX_BLOCK_SIZE];
+  if (!(dir->flags & EXT2_INDEX_FL) ||
+      getInode(disk, dir->file_acl, index_inode) == FAILURE) {
+    return FAILURE;
+  }
+  UINT32 block_idx = mapFileBlock(disk, index_inode, 0, NULL);
+  if (block_idx == 0 || readBlock(disk, block_idx, block) == FAILURE) {
+    return FAILURE;
+  }
+  memcpy(header, block, sizeof(Ext2DirIndexHeader));
+  if (header->magic != EXT2_DIR_INDEX_MAGIC || header->capacity == 0 ||
+      (header->capacity & (header->capacity - 1)) != 0) {
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+static int writeHeader(Disk* disk,
+                       Ext2Inode* index_inode,
+                       Ext2DirIndexHeader* header) {
+  BYTE block[MAX_BLOCK_SIZE];
+  UINT32 block_idx = mapFileBlock(disk, index_inode, 0, NULL);
+  if (block_idx == 0 || readBlock(disk, block_idx, block) == FAILURE) {
+    return FAILURE;
+  }
+  memcpy(block, header, sizeof(Ext2DirIndexHeader));
+  return writeBlock(disk, block_idx, block);
+}
+
+// 返回第 pos 个槽位，所在的块不是 *loaded 时读入 block。
+// 探测通常停留在同一个块中，只在跨块时才重新读
+static Ext2DirIndexSlot* loadSlot(Disk* disk,
+                                  Ext2Inode* index_inode,
+                                  UINT32 pos,
+                                  BYTE* block,
+                                  UINT32* loaded) {
+  UINT32 spb = slotsPerBlock(disk);
+  UINT32 block_idx = mapFileBlock(disk, index_inode, 1 + pos / spb, NULL);
+  if (block_idx == 0) {
+    return NULL;
+  }
+  if (block_idx != *loaded) {
+    if (readBlock(disk, block_idx, block) == FAILURE) {
+      *loaded = 0;
+      return NULL;
+    }
+    *loaded = block_idx;
+  }
+  return (Ext2DirIndexSlot*)block + pos % spb;
+}
+
+// 找到哈希值为 hash、指向第 index 个目录项的槽位，返回它在 block 中的位置
+static Ext2DirIndexSlot* findSlot(Disk* disk,
+                                  Ext2Inode* index_inode,
+                                  Ext2DirIndexHeader* header,
+                                  UINT32 hash,
+                                  unsigned int index,
+                                  BYTE* block,
+                                  UINT32* loaded) {
+  UINT32 mask = header->capacity - 1;
+  UINT32 pos = hash & mask;
+  for (UINT32 n = 0; n < header->capacity; n++, pos = (pos + 1) & mask) {
+    Ext2DirIndexSlot* slot = loadSlot(disk, index_inode, pos, block, loaded);
+    if (slot == NULL || slot->entry == EXT2_DIR_INDEX_EMPTY) {
+      return NULL;
+    }
+    if (slot->hash == hash && slot->entry == index + 1) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+int dirIndexLookup(Disk* disk,
+                   Ext2Inode* dir,
+                   const char* name,
+                   Ext2DirEntry* entry,
+                   unsigned int* index) {
+  Ext2Inode index_inode;
+  Ext2DirIndexHeader header;
+  if (openIndex(disk, dir, &index_inode, &header) == FAILURE) {
+    return FAILURE;
+  }
+  BYTE block[MAX_BLOCK_SIZE];
+  UINT32 loaded = 0;
+  UINT32 hash = dirNameHash(name);
+  UINT32 mask = header.capacity - 1;
+  UINT32 pos = hash & mask;
+  for (UINT32 n = 0; n < header.capacity; n++, pos = (pos + 1) & mask) {
+    Ext2DirIndexSlot* slot = loadSlot(disk, &index_inode, pos, block, &loaded);
+    if (slot == NULL || slot->entry == EXT2_DIR_INDEX_EMPTY) {
+      return FAILURE;
+    }
+    if (slot->entry == EXT2_DIR_INDEX_DELETED || slot->hash != hash) {
+      continue;
+    }
+    // 哈希值相同时还要比较目录项中的文件名
+    unsigned int i = slot->entry - 1;
+    if (i < dir->size / DIR_SIZE &&
+        getDirEntry(disk, i, dir, entry) == SUCCESS &&
+        !strcmp(entry->name, name)) {
+      *index = i;
+      return SUCCESS;
+    }
+  }
+  return FAILURE;
+}
+
+int dirIndexBuild(Disk* disk, Ext2Inode* dir) {
+  Ext2Layout* layout = disk->layout;
+  UINT32 spb = slotsPerBlock(disk);
+  UINT32 items = dir->size / DIR_SIZE;
+  // 装载率不超过一半，探测序列才足够短
+  UINT32 capacity = spb;
+  while (capacity < items * 2) {
+    capacity *= 2;
+  }
+  UINT32 blocks = 1 + capacity / spb;
+
+  unsigned int index_idx = dir->file_acl;
+  Ext2Location location;
+  Ext2Inode index_inode;
+  if (dir->flags & EXT2_INDEX_FL) {
+    // 重建时沿用原来的索引文件，先释放它的全部块
+    getInode(disk, index_idx, &index_inode);
+    truncateFileBlocks(disk, &index_inode, 0);
+    location = getInodeLocation(disk, index_idx);
+  } else {
+    location = getFreeInode(disk, &index_idx);
+    if (location.block_idx == (UINT32)-1) {
+      return FAILURE;
+    }
+    memset(&index_inode, 0, INODE_SIZE);
+    index_inode.mode = EXT2_FILE;
+    initInodeMap(disk, &index_inode);
+    dir->flags |= EXT2_INDEX_FL;
+    dir->file_acl = index_idx;
+  }
+  index_inode.blocks = 0;
+  index_inode.size = 0;
+
+  BYTE* buffer = calloc(blocks, layout->block_size);
+  DiskRequest* requests = malloc(blocks * sizeof(DiskRequest));
+  if (buffer == NULL || requests == NULL) {
+    free(buffer);
+    free(requests);
+    writeInode(disk, &index_inode, &location);
+    dirIndexDrop(disk, dir);
+    return FAILURE;
+  }
+  // 在内存中建好整张表，目录块每块只读一次
+  Ext2DirIndexHeader* header = (Ext2DirIndexHeader*)buffer;
+  Ext2DirIndexSlot* slots = (Ext2DirIndexSlot*)(buffer + layout->block_size);
+  UINT32 mask = capacity - 1;
+  Ext2DirIter iter;
+  Ext2DirEntry entry;
+  unsigned int i;
+  dirIterInit(&iter, disk, dir, 0);
+  while (dirIterNext(&iter, &entry, &i) == SUCCESS) {
+    UINT32 hash = dirNameHash(entry.name);
+    UINT32 pos = hash & mask;
+    while (slots[pos].entry != EXT2_DIR_INDEX_EMPTY) {
+      pos = (pos + 1) & mask;
+    }
+    slots[pos].hash = hash;
+    slots[pos].entry = i + 1;
+  }
+  header->magic = EXT2_DIR_INDEX_MAGIC;
+  header->capacity = capacity;
+  header->used = items;
+  header->deleted = 0;
+
+  // 索引文件尽量连续分配，整张表用一次批量写入
+  int ret = SUCCESS;
+  UINT32 done = 0;
+  UINT32 prev = 0;
+  while (done < blocks) {
+    unsigned int got;
+    Ext2Location run =
+        allocBlocks(disk, prev == 0 ? 0 : prev + 1, blocks - done, &got);
+    if (got == 0) {
+      ret = FAILURE;
+      break;
+    }
+    if (appendFileBlocks(disk, &index_inode, done, run.block_idx, got) ==
+        FAILURE) {
+      freeBlocks(disk, run.block_idx, got);
+      ret = FAILURE;
+      break;
+    }
+    for (UINT32 k = 0; k < got; k++) {
+      requests[done + k].block_idx = run.block_idx + k;
+      requests[done + k].data = buffer + (done + k) * layout->block_size;
+    }
+    index_inode.blocks += got;
+    done += got;
+    prev = run.block_idx + got - 1;
+  }
+  if (ret == SUCCESS) {
+    ret = writeBlocks(disk, requests, blocks);
+  }
+  index_inode.size = blocks * layout->block_size;
+  writeInode(disk, &index_inode, &location);
+  free(buffer);
+  free(requests);
+  if (ret == FAILURE) {
+    printf("No free blocks left for the directory index\n");
+    dirIndexDrop(disk, dir);
+  }
+  return ret;
+}
+
+int dirIndexInsert(Disk* disk,
+                   Ext2Inode* dir,
+                   const char* name,
+                   unsigned int index) {
+  Ext2Inode index_inode;
+  Ext2DirIndexHeader header;
+  if (openIndex(disk, dir, &index_inode, &header) == FAILURE) {
+    return FAILURE;
+  }
+  if ((header.used + header.deleted + 1) * 2 > header.capacity) {
+    // 新目录项已经在目录中，重建时一并加入
+    return dirIndexBuild(disk, dir);
+  }
+  BYTE block[MAX_BLOCK_SIZE];
+  UINT32 loaded = 0;
+  UINT32 hash = dirNameHash(name);
+  UINT32 mask = header.capacity - 1;
+  UINT32 pos = hash & mask;
+  for (UINT32 n = 0; n < header.capacity; n++, pos = (pos + 1) & mask) {
+    Ext2DirIndexSlot* slot = loadSlot(disk, &index_inode, pos, block, &loaded);
+    if (slot == NULL) {
+      return FAILURE;
+    }
+    if (slot->entry == EXT2_DIR_INDEX_EMPTY ||
+        slot->entry == EXT2_DIR_INDEX_DELETED) {
+      if (slot->entry == EXT2_DIR_INDEX_DELETED) {
+        header.deleted--;
+      }
+      slot->hash = hash;
+      slot->entry = index + 1;
+      header.used++;
+      writeBlock(disk, loaded, block);
+      return writeHeader(disk, &index_inode, &header);
+    }
+  }
+  return FAILURE;
+}
+
+int dirIndexRemove(Disk* disk,
+                   Ext2Inode* dir,
+                   const char* name,
+                   unsigned int index,
+                   const char* moved_name,
+                   unsigned int moved_from) {
+  Ext2Inode index_inode;
+  Ext2DirIndexHeader header;
+  if (openIndex(disk, dir, &index_inode, &header) == FAILURE) {
+    return FAILURE;
+  }
+  BYTE block[MAX_BLOCK_SIZE];
+  UINT32 loaded = 0;
+  // 删除的槽位留下标记，探测序列才不会在这里断开
+  Ext2DirIndexSlot* slot = findSlot(disk, &index_inode, &header,
+                                    dirNameHash(name), index, block, &loaded);
+  if (slot == NULL) {
+    return FAILURE;
+  }
+  slot->entry = EXT2_DIR_INDEX_DELETED;
+  header.used--;
+  header.deleted++;
+  writeBlock(disk, loaded, block);
+  if (moved_from != index) {
+    slot = findSlot(disk, &index_inode, &header, dirNameHash(moved_name),
+                    moved_from, block, &loaded);
+    if (slot == NULL) {
+      return FAILURE;
+    }
+    slot->entry = index + 1;
+    writeBlock(disk, loaded, block);
+  }
+  return writeHeader(disk, &index_inode, &header);
+}
+
+void dirIndexDrop(Disk* disk, Ext2Inode* dir) {
+  if (!(dir->flags & EXT2_INDEX_FL)) {
+    return;
+  }
+  Ext2Inode index_inode;
+  if (getInode(disk, dir->file_acl, &index_inode) == SUCCESS) {
+    truncateFileBlocks(disk, &index_inode, 0);
+    freeInode(disk, dir->file_acl);
+  }
+  dir->flags &= ~EXT2_INDEX_FL;
+  dir->file_acl = 0;
+}
@@ -0,0 +1,108 @@
+#ifndef __DIRINDEX_H__
+#define __DIRINDEX_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+#include "ext2.h"
+
+#define EXT2_DIR_INDEX_MAGIC 0x48545245
+// 槽位中 entry 的特殊取值，其余取值是目录项序号加 1
+#define EXT2_DIR_INDEX_EMPTY 0
+#define EXT2_DIR_INDEX_DELETED 0xFFFFFFFF
+
+/**
+ * @brief 目录索引文件的头部，存放在索引文件的第一块。之后的块是一张线性
+ * 探测的哈希表，目录项本身仍按原来的线性顺序存放在目录中
+ *
+ */
+typedef struct Ext2DirIndexHeader {
+  UINT32 magic;     // EXT2_DIR_INDEX_MAGIC
+  UINT32 capacity;  // 槽位数，2 的幂
+  UINT32 used;      // 指向目录项的槽位数
+  UINT32 deleted;   // 已删除的槽位数，重建时清除
+} Ext2DirIndexHeader;
+
+/**
+ * @brief 哈希表中的一个槽位，占用大小 8 bytes
+ *
+ */
+typedef struct Ext2DirIndexSlot {
+  UINT32 hash;   // 文件名的哈希值
+  UINT32 entry;  // 目录项序号加 1，或 EXT2_DIR_INDEX_EMPTY/DELETED
+} Ext2DirIndexSlot;
+
+/**
+ * @brief 文件名的哈希值 (FNV-1a)
+ *
+ * @param name
+ * @return UINT32
+ */
+UINT32 dirNameHash(const char* name);
+
+/**
+ * @brief 通过哈希索引查找目录中名为 name 的目录项，通常只需读一个索引块和
+ * 一个目录块
+ *
+ * @param disk
+ * @param dir 带有 EXT2_INDEX_FL 的目录
+ * @param name
+ * @param entry 返回找到的目录项
+ * @param index 返回目录项的序号
+ * @return int 不存在时返回 FAILURE
+ */
+int dirIndexLookup(Disk* disk, Ext2Inode* dir, const char* name,
+                   Ext2DirEntry* entry, unsigned int* index);
+
+/**
+ * @brief 按目录现有的全部目录项重新建立索引，第一次建立时分配索引文件的
+ * inode 并设置 EXT2_INDEX_FL。失败时去掉索引，目录退回线性查找
+ *
+ * @param disk
+ * @param dir 由调用者写回
+ * @return int
+ */
+int dirIndexBuild(Disk* disk, Ext2Inode* dir);
+
+/**
+ * @brief 把刚追加的第 index 个目录项加入索引，装载率超过一半时重建并扩大
+ * 哈希表
+ *
+ * @param disk
+ * @param dir
+ * @param name
+ * @param index
+ * @return int
+ */
+int dirIndexInsert(Disk* disk, Ext2Inode* dir, const char* name,
+                   unsigned int index);
+
+/**
+ * @brief 删除第 index 个目录项后更新索引。最后一个目录项 moved_from 被移到
+ * index 处，两者相同时表示删除的就是最后一项
+ *
+ * @param disk
+ * @param dir
+ * @param name 被删除的文件名
+ * @param index
+ * @param moved_name 被移动的文件名
+ * @param moved_from
+ * @return int
+ */
+int dirIndexRemove(Disk* disk, Ext2Inode* dir, const char* name,
+                   unsigned int index, const char* moved_name,
+                   unsigned int moved_from);
+
+/**
+ * @brief 释放目录的索引文件并去掉 EXT2_INDEX_FL，目录被删除或索引损坏时
+ * 调用
+ *
+ * @param disk
+ * @param dir 由调用者写回
+ */
+void dirIndexDrop(Disk* disk, Ext2Inode* dir);
+
+#endif  // __DIRINDEX_H__
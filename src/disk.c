@@ -1,31 +1,57 @@
 #include "disk.h"
 
-int makeDisk(Disk* disk, const char* path) {
+#include "uring.h"
+
+int makeDisk(Disk* disk, const char* path, UINT64 size) {
   if (disk == NULL) {
     disk = malloc(sizeof(Disk));
   }
 
+  // 块号是 32 位的，超过 2^32 个扇区的镜像无法寻址
+  if (size / SECTOR_SIZE > UINT_MAX) {
+    printf("disk size %llu is too large\n", size);
+    return FAILURE;
+  }
+
   strcpy(disk->path, path);
 
   disk->write_disk = &writeDisk;
   disk->read_disk = &readDisk;
+  disk->write_disk_v = &writeDiskV;
+  disk->read_disk_v = &readDiskV;
+  disk->cache = NULL;
+  disk->map = NULL;
+  disk->map_size = 0;
+  disk->uring = NULL;
+  disk->layout = NULL;
+  disk->block_size = SECTOR_SIZE;
+  disk->blocks_count = size / SECTOR_SIZE;
 
-  FILE* f = fopen(path, "w+");
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
-  for (unsigned int i = 0; i < NUMBER_OF_BLOCKS; i++) {
-    fseek(f, i * BLOCK_SIZE, SEEK_SET);
-    fwrite(block, BLOCK_SIZE, 1, f);
-    writeDisk(disk, i, block);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  disk->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (disk->fd < 0) {
+    printf("failed to create disk \"%s\"\n", path);
+    return FAILURE;
   }
-  fclose(f);
+  // ftruncate 得到的稀疏文件读出来全为 0，不需要逐块写零，
+  // format 时只会写入真正用到的块
+  if (ftruncate(disk->fd, (off_t)disk->blocks_count * SECTOR_SIZE) < 0) {
+    printf("failed to create disk \"%s\"\n", path);
+    close(disk->fd);
+    disk->fd = -1;
+    return FAILURE;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (end.tv_sec - start.tv_sec) * 1e3 +
+                   (end.tv_nsec - start.tv_nsec) / 1e6;
 
   printf("Successfully make disk named \"%s\"!\n", path);
-  printf("    Total Size:       %d bytes\n", BLOCK_SIZE * NUMBER_OF_BLOCKS);
-  printf("    Number of Blocks: %d\n", NUMBER_OF_BLOCKS);
-  printf("    Block Size:       %d bytes\n", BLOCK_SIZE);
+  printf("    Total Size:       %llu bytes\n",
+         (UINT64)disk->blocks_count * SECTOR_SIZE);
+  printf("    Number of Sectors: %u\n", disk->blocks_count);
   printf("    Sector Size:      %d bytes\n", SECTOR_SIZE);
-  printf("    Sectors per Blocks: %d\n\n", SECTORS_PRE_BLOCK);
+  printf("    Time Used:        %.3f ms\n\n", elapsed);
   return SUCCESS;
 }
 
@@ -37,40 +63,231 @@ int loadDisk(Disk* disk, const char* path) {
   strcpy(disk->path, path);
   disk->read_disk = &readDisk;
   disk->write_disk = &writeDisk;
+  disk->read_disk_v = &readDiskV;
+  disk->write_disk_v = &writeDiskV;
+  disk->cache = NULL;
+  disk->map = NULL;
+  disk->map_size = 0;
+  disk->uring = NULL;
+  disk->layout = NULL;
+
+  // 挂载期间只打开一次，之后的读写都复用这个描述符
+  disk->fd = open(path, O_RDWR);
+  if (disk->fd < 0) {
+    printf("failed to open disk \"%s\"\n", path);
+    return FAILURE;
+  }
+  // 在读到超级块之前按扇区大小访问
+  setDiskGeometry(disk, SECTOR_SIZE);
 
   return SUCCESS;
 }
 
+int setDiskGeometry(Disk* disk, unsigned int block_size) {
+  struct stat st;
+  if (fstat(disk->fd, &st) < 0) {
+    return FAILURE;
+  }
+  UINT64 blocks = (UINT64)st.st_size / block_size;
+  disk->block_size = block_size;
+  disk->blocks_count = blocks > UINT_MAX ? UINT_MAX : (unsigned int)blocks;
+  return SUCCESS;
+}
+
+int loadDiskMmap(Disk* disk, const char* path) {
+  if (loadDisk(disk, path) == FAILURE) {
+    return FAILURE;
+  }
+
+  struct stat st;
+  // 32 位平台上地址空间放不下超过 SIZE_MAX 的镜像
+  if (fstat(disk->fd, &st) < 0 || st.st_size < SECTOR_SIZE ||
+      (UINT64)st.st_size > SIZE_MAX) {
+    printf("failed to map disk \"%s\"\n", path);
+    closeDisk(disk);
+    return FAILURE;
+  }
+  void* map =
+      mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, disk->fd, 0);
+  if (map == MAP_FAILED) {
+    printf("failed to map disk \"%s\"\n", path);
+    closeDisk(disk);
+    return FAILURE;
+  }
+  disk->map = (BYTE*)map;
+  disk->map_size = st.st_size;
+  disk->read_disk = &readDiskMmap;
+  disk->write_disk = &writeDiskMmap;
+  disk->read_disk_v = &readDiskMmapV;
+  disk->write_disk_v = &writeDiskMmapV;
+
+  return SUCCESS;
+}
+
+int syncDisk(Disk* disk) {
+  if (disk->map != NULL) {
+    msync(disk->map, disk->map_size, MS_ASYNC);
+  }
+  return SUCCESS;
+}
+
+int closeDisk(Disk* disk) {
+  if (disk == NULL || disk->fd < 0) {
+    return FAILURE;
+  }
+  if (disk->map != NULL) {
+    // 卸载时等待映射区域完全落盘
+    msync(disk->map, disk->map_size, MS_SYNC);
+    munmap(disk->map, disk->map_size);
+    disk->map = NULL;
+    disk->map_size = 0;
+  }
+  if (disk->uring != NULL) {
+    destroyUringQueue(disk->uring);
+    disk->uring = NULL;
+  }
+  close(disk->fd);
+  disk->fd = -1;
+  return SUCCESS;
+}
+
 int writeDisk(Disk* disk, unsigned int block_idx, void* data) {
   assert(data != NULL);
-  if (block_idx >= NUMBER_OF_BLOCKS) {
+  if (block_idx >= disk->blocks_count) {
     printf("failed to write\n");
     return FAILURE;
   }
 
-  FILE* f = fopen(disk->path, "r+");
-
-  fseek(f, block_idx * BLOCK_SIZE, SEEK_SET);
-  fwrite(data, BLOCK_SIZE, 1, f);
-
-  fclose(f);
+  if (pwrite(disk->fd, data, disk->block_size,
+             (off_t)block_idx * disk->block_size) != disk->block_size) {
+    printf("failed to write\n");
+    return FAILURE;
+  }
   return SUCCESS;
 }
 
 int readDisk(Disk* disk, unsigned int block_idx, void* data) {
   assert(data != NULL);
-  if (block_idx >= NUMBER_OF_BLOCKS) {
+  if (block_idx >= disk->blocks_count) {
+    printf("failed to read\n");
+    return FAILURE;
+  }
+
+  memset(data, 0, disk->block_size);
+
+  if (pread(disk->fd, data, disk->block_size,
+            (off_t)block_idx * disk->block_size) < 0) {
     printf("failed to read\n");
     return FAILURE;
   }
+  return SUCCESS;
+}
 
-  memset(data, 0, BLOCK_SIZE);
+// 从 requests[start] 开始块号连续的请求个数
+static unsigned int runLength(DiskRequest* requests,
+                              unsigned int start,
+                              unsigned int count) {
+  unsigned int n = 1;
+  while (start + n < count && n < IOV_MAX &&
+         requests[start + n].block_idx ==
+             requests[start + n - 1].block_idx + 1) {
+    n++;
+  }
+  return n;
+}
 
-  FILE* f = fopen(disk->path, "r+");
+int writeDiskV(Disk* disk, DiskRequest* requests, unsigned int count) {
+  struct iovec iov[IOV_MAX];
+  unsigned int i = 0;
+  while (i < count) {
+    unsigned int n = runLength(requests, i, count);
+    if (requests[i + n - 1].block_idx >= disk->blocks_count) {
+      printf("failed to write\n");
+      return FAILURE;
+    }
+    for (unsigned int j = 0; j < n; j++) {
+      assert(requests[i + j].data != NULL);
+      iov[j].iov_base = requests[i + j].data;
+      iov[j].iov_len = disk->block_size;
+    }
+    ssize_t expect = (ssize_t)n * disk->block_size;
+    if (pwritev(disk->fd, iov, n,
+                (off_t)requests[i].block_idx * disk->block_size) != expect) {
+      printf("failed to write\n");
+      return FAILURE;
+    }
+    i += n;
+  }
+  return SUCCESS;
+}
 
-  fseek(f, block_idx * BLOCK_SIZE, SEEK_SET);
-  fread(data, BLOCK_SIZE, 1, f);
+int readDiskV(Disk* disk, DiskRequest* requests, unsigned int count) {
+  struct iovec iov[IOV_MAX];
+  unsigned int i = 0;
+  while (i < count) {
+    unsigned int n = runLength(requests, i, count);
+    if (requests[i + n - 1].block_idx >= disk->blocks_count) {
+      printf("failed to read\n");
+      return FAILURE;
+    }
+    for (unsigned int j = 0; j < n; j++) {
+      assert(requests[i + j].data != NULL);
+      memset(requests[i + j].data, 0, disk->block_size);
+      iov[j].iov_base = requests[i + j].data;
+      iov[j].iov_len = disk->block_size;
+    }
+    if (preadv(disk->fd, iov, n,
+               (off_t)requests[i].block_idx * disk->block_size) < 0) {
+      printf("failed to read\n");
+      return FAILURE;
+    }
+    i += n;
+  }
+  return SUCCESS;
+}
 
-  fclose(f);
+int writeDiskMmap(Disk* disk, unsigned int block_idx, void* data) {
+  assert(data != NULL);
+  size_t offset = (size_t)block_idx * disk->block_size;
+  if (block_idx >= disk->blocks_count ||
+      offset + disk->block_size > disk->map_size) {
+    printf("failed to write\n");
+    return FAILURE;
+  }
+
+  memcpy(disk->map + offset, data, disk->block_size);
+  return SUCCESS;
+}
+
+int readDiskMmap(Disk* disk, unsigned int block_idx, void* data) {
+  assert(data != NULL);
+  size_t offset = (size_t)block_idx * disk->block_size;
+  if (block_idx >= disk->blocks_count ||
+      offset + disk->block_size > disk->map_size) {
+    printf("failed to read\n");
+    return FAILURE;
+  }
+
+  memcpy(data, disk->map + offset, disk->block_size);
+  return SUCCESS;
+}
+
+int writeDiskMmapV(Disk* disk, DiskRequest* requests, unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    if (writeDiskMmap(disk, requests[i].block_idx, requests[i].data) ==
+        FAILURE) {
+      return FAILURE;
+    }
+  }
+  return SUCCESS;
+}
+
+int readDiskMmapV(Disk* disk, DiskRequest* requests, unsigned int count) {
+  for (unsigned int i = 0; i < count; i++) {
+    if (readDiskMmap(disk, requests[i].block_idx, requests[i].data) ==
+        FAILURE) {
+      return FAILURE;
+    }
+  }
   return SUCCESS;
 }
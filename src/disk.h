@@ -1,23 +1,63 @@
 #ifndef __DISK_H__
 #define __DISK_H__
 
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "common.h"
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// 磁盘读写后端
+#define DISK_BACKEND_PREAD 0
+#define DISK_BACKEND_MMAP 1
+#define DISK_BACKEND_URING 2
+
+/**
+ * @brief 一次块读写请求：块号和对应的数据缓冲区
+ *
+ */
+typedef struct DiskRequest {
+  unsigned int block_idx;  // 块号
+  void* data;              // 数据指针，大小为一个块
+} DiskRequest;
+
 /**
  * @brief 记录磁盘文件信息
  *
  */
 typedef struct Disk {
   char path[128];      // 磁盘路径
+  int fd;              // 挂载期间一直打开的文件描述符
+  unsigned int block_size;    // 块大小，读到超级块前为 SECTOR_SIZE
+  unsigned int blocks_count;  // 磁盘文件中的块数
+  struct BlockCache* cache;  // 块缓存，为 NULL 时直接读写磁盘
+  BYTE* map;           // mmap 映射的磁盘内容，为 NULL 时使用 pread/pwrite
+  size_t map_size;     // 映射区域的大小
+  struct UringQueue* uring;  // io_uring 队列，为 NULL 时不使用 io_uring
+  struct Ext2Layout* layout;  // 已 format 或挂载的文件系统布局
 
   // 读磁盘
   int (*write_disk)(struct Disk* disk, unsigned int block_idx, void* data);
   // 写磁盘
   int (*read_disk)(struct Disk* disk, unsigned int block_idx, void* data);
+  // 批量写磁盘，块号相邻的请求合并为一次 pwritev
+  int (*write_disk_v)(struct Disk* disk, DiskRequest* requests,
+                      unsigned int count);
+  // 批量读磁盘，块号相邻的请求合并为一次 preadv
+  int (*read_disk_v)(struct Disk* disk, DiskRequest* requests,
+                     unsigned int count);
 } Disk;
 
 /**
@@ -41,24 +81,74 @@ int writeDisk(Disk* disk, unsigned int block_idx, void* data);
 int readDisk(Disk* disk, unsigned int block_idx, void* data);
 
 /**
- * @brief 从路径初始化一个磁盘文件
+ * @brief 批量写入 count 个块，块号连续的请求合并成一次 pwritev
  *
- * @param disk 磁盘指针
- * @param path 磁盘路径
- * @param number_of_sectors 扇区数量
- * @param sector_size 扇区大小
- * @param sectors_per_block 每个块有多少扇区
+ * @param disk
+ * @param requests 请求数组
+ * @param count 请求个数
+ * @return int
+ */
+int writeDiskV(Disk* disk, DiskRequest* requests, unsigned int count);
+
+/**
+ * @brief 批量读取 count 个块，块号连续的请求合并成一次 preadv
+ *
+ * @param disk
+ * @param requests 请求数组
+ * @param count 请求个数
  * @return int
  */
+int readDiskV(Disk* disk, DiskRequest* requests, unsigned int count);
+
+/**
+ * @brief mmap 后端的写操作，直接拷贝到映射区域
+ *
+ * @param disk
+ * @param block_idx
+ * @param data
+ * @return int
+ */
+int writeDiskMmap(Disk* disk, unsigned int block_idx, void* data);
+
+/**
+ * @brief mmap 后端的读操作，直接从映射区域拷贝
+ *
+ * @param disk
+ * @param block_idx
+ * @param data
+ * @return int
+ */
+int readDiskMmap(Disk* disk, unsigned int block_idx, void* data);
+
+/**
+ * @brief mmap 后端的批量写操作
+ *
+ * @param disk
+ * @param requests
+ * @param count
+ * @return int
+ */
+int writeDiskMmapV(Disk* disk, DiskRequest* requests, unsigned int count);
+
+/**
+ * @brief mmap 后端的批量读操作
+ *
+ * @param disk
+ * @param requests
+ * @param count
+ * @return int
+ */
+int readDiskMmapV(Disk* disk, DiskRequest* requests, unsigned int count);
 
 /**
  * @brief 从路径初始化一个磁盘文件
  *
  * @param disk 磁盘指针
  * @param path 磁盘路径
+ * @param size 磁盘大小 (byte)，按扇区大小向下取整
  * @return int
  */
-int makeDisk(Disk* disk, const char* path);
+int makeDisk(Disk* disk, const char* path, UINT64 size);
 
 /**
  * @brief 从路径 path 加载一个 disk
@@ -69,4 +159,40 @@ int makeDisk(Disk* disk, const char* path);
  */
 int loadDisk(Disk* disk, const char* path);
 
+/**
+ * @brief 设置 disk 的块大小，并根据磁盘文件大小重新计算块数
+ *
+ * @param disk
+ * @param block_size
+ * @return int
+ */
+int setDiskGeometry(Disk* disk, unsigned int block_size);
+
+/**
+ * @brief 以 MAP_SHARED 方式将整个磁盘文件映射到内存后加载
+ *
+ * @param disk
+ * @param path
+ * @return int
+ */
+int loadDiskMmap(Disk* disk, const char* path);
+
+/**
+ * @brief 将 disk 上的修改提交给操作系统。mmap 后端会发起异步 msync，
+ * pread/pwrite 后端的数据已在内核中，无需处理
+ *
+ * @param disk
+ * @return int
+ */
+int syncDisk(Disk* disk);
+
+/**
+ * @brief 关闭 disk 持有的文件描述符，mmap 后端会先同步 msync 再解除映射，
+ * io_uring 后端会等待所有在途请求完成
+ *
+ * @param disk
+ * @return int
+ */
+int closeDisk(Disk* disk);
+
 #endif  // __DISK_H__
\ No newline at end of file
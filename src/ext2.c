@@ -1,10 +1,21 @@
 #include "ext2.h"
 
+#include "dcache.h"
+#include "dirindex.h"
+#include "extent.h"
+#include "icache.h"
+#include "indirect.h"
+#include "path.h"
+#include "readdir.h"
+
 int checkExt2(char* path) {
   Disk disk;
   Ext2SuperBlock super_block;
-  loadDisk(&disk, path);
+  if (loadDisk(&disk, path) == FAILURE) {
+    return FAILURE;
+  }
   getSuperBlock(&disk, &super_block);
+  closeDisk(&disk);
   if (super_block.magic == LINUX) {
     return SUCCESS;
   } else {
@@ -12,104 +23,369 @@ int checkExt2(char* path) {
   }
 }
 
-int ext2Format(Disk* disk) {
+// groups_count 个组的组描述符表占用的块数
+static UINT32 gdtBlocks(UINT32 groups_count, UINT32 block_size) {
+  UINT32 per_block = block_size / GD_SIZE;
+  return (groups_count + per_block - 1) / per_block;
+}
+
+// 第 group 个组元数据的起始块，0 号组前面还有超级块和组描述符表
+static UINT32 groupMetaBase(UINT32 blocks_per_group,
+                            UINT32 gdt_blocks,
+                            UINT32 group) {
+  return group * blocks_per_group +
+         (group == 0 ? GDT_BLOCK_BASE + gdt_blocks : 0);
+}
+
+// 第 group 个组包含的块数，最后一个组可能不满
+static UINT32 groupBlocks(UINT32 blocks_count,
+                          UINT32 blocks_per_group,
+                          UINT32 group) {
+  UINT32 remain = blocks_count - group * blocks_per_group;
+  return remain < blocks_per_group ? remain : blocks_per_group;
+}
+
+// inode 平均分到各组，每组的 inode 位图同样只占一个块
+static UINT32 inodesPerGroup(UINT32 blocks_count,
+                             UINT32 groups_count,
+                             UINT32 block_size,
+                             UINT32 inode_ratio) {
+  UINT32 inodes_per_block = block_size / INODE_SIZE;
+  UINT32 inodes_per_group =
+      (UINT32)((UINT64)blocks_count * block_size / inode_ratio / groups_count);
+  if (inodes_per_group > block_size * 8) {
+    inodes_per_group = block_size * 8;
+  }
+  inodes_per_group -= inodes_per_group % inodes_per_block;
+  if (inodes_per_group == 0) {
+    inodes_per_group = inodes_per_block;
+  }
+  return inodes_per_group;
+}
+
+// 输出启用的特性名，每个前面带一个空格
+static void printFeatures(Ext2SuperBlock* super_block) {
+  if (super_block->feature_incompat & EXT2_FEATURE_INCOMPAT_EXTENTS) {
+    printf(" extents");
+  }
+  if (super_block->feature_compat & EXT2_FEATURE_COMPAT_DIR_INDEX) {
+    printf(" dir_index");
+  }
+  printf("\n");
+}
+
+int ext2Format(Disk* disk,
+               unsigned int block_size,
+               unsigned int inode_ratio,
+               UINT32 features,
+               UINT32 compat_features) {
   assert(disk != NULL);
   Ext2SuperBlock super_block;
   Ext2GroupDescTable gdt;
 
+  assert(sizeof(Ext2GroupDesc) == GD_SIZE);
+  if (block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE ||
+      (block_size & (block_size - 1)) != 0) {
+    printf("Invalid block size %u, it should be one of 512/1024/2048/4096\n",
+           block_size);
+    return FAILURE;
+  }
+  if (inode_ratio < block_size) {
+    printf("Invalid inode ratio %u, it should be at least the block size\n",
+           inode_ratio);
+    return FAILURE;
+  }
+  setDiskGeometry(disk, block_size);
+  UINT32 blocks_count = disk->blocks_count;
+  // 每个组的块位图占一个块，组描述符表的块数随组数增长
+  UINT32 blocks_per_group = block_size * 8;
+  UINT32 groups_count =
+      (blocks_count + blocks_per_group - 1) / blocks_per_group;
+  UINT32 inodes_per_block = block_size / INODE_SIZE;
+  UINT32 inodes_per_group = inodesPerGroup(blocks_count, groups_count,
+                                           block_size, inode_ratio);
+  // 两个位图和 inode 表，组内至少还要留一个数据块
+  UINT32 meta_blocks = 2 + inodes_per_group / inodes_per_block;
+  if (groups_count > 1 &&
+      groupBlocks(blocks_count, blocks_per_group, groups_count - 1) <=
+          meta_blocks) {
+    // 最后一个组放不下自己的元数据，直接舍去
+    groups_count--;
+    blocks_count = groups_count * blocks_per_group;
+    inodes_per_group = inodesPerGroup(blocks_count, groups_count, block_size,
+                                      inode_ratio);
+    meta_blocks = 2 + inodes_per_group / inodes_per_block;
+  }
+  // 组描述符表和 0 号组的元数据都要放在 0 号组中
+  UINT32 gdt_blocks = gdtBlocks(groups_count, block_size);
+  if (GDT_BLOCK_BASE + gdt_blocks + meta_blocks >=
+      groupBlocks(blocks_count, blocks_per_group, 0)) {
+    if (groups_count == 1) {
+      printf("The disk is too small to format\n");
+    } else {
+      printf("Too many groups (%u) for block size %u, use a larger one\n",
+             groups_count, block_size);
+    }
+    return FAILURE;
+  }
+
   // 初始化超级块和组描述符
-  initSuperBlock(&super_block);
-  initGdt(&gdt, &super_block);
-  // 将超级块和组描述符，两个位图都写入
+  initSuperBlock(&super_block, block_size, blocks_count, inodes_per_group);
+  super_block.feature_incompat = features;
+  super_block.feature_compat = compat_features;
+  if (initGdt(&gdt, &super_block) == FAILURE) {
+    printf("Failed to allocate the group descriptor table\n");
+    return FAILURE;
+  }
+  // 将超级块和组描述符写入后建立布局，再初始化各组的两个位图
   writeSuperBlock(disk, &super_block);
   writeGdt(disk, &gdt);
+  freeGdt(&gdt);
+  if (loadLayout(disk, &super_block) == FAILURE) {
+    freeLayout(disk);
+    return FAILURE;
+  }
   initInodeBitmap(disk);
   initBlockBitmap(disk);
 
   initRootDir(disk);
+  syncMetadata(disk);
 
+  Ext2Layout* layout = disk->layout;
+  super_block = layout->super_block;
   printf("Successfully format the disk \"%s\" to Ext2\n", disk->path);
   printf("\nDisk Info:\n");
+  printf("    Block Size:        %d bytes\n", layout->block_size);
+  printf("    Blocks Count:      %d\n", layout->blocks_count);
+  printf("    Inodes Count:      %d\n", layout->inodes_count);
+  printf("    Groups Count:      %d\n", layout->groups_count);
+  printf("    Blocks Per Group:  %d\n", layout->blocks_per_group);
+  printf("    Inodes Per Group:  %d\n", layout->inodes_per_group);
   printf("    Super Block Base:  %d\n", SUPER_BLOCK_BASE);
   printf("    GDT Block Base:    %d\n", GDT_BLOCK_BASE);
-  printf("    Inode Bitmap Base: %d\n", INODE_BITMAP_BASE);
-  printf("    Block Bitmap Base: %d\n", BLOCK_BITMAP_BASE);
-  printf("    Inode Table Base:  %d\n", INODE_TABLE_BASE);
-  printf("    Data Block Base:   %d\n", DATA_BLOCK_BASE);
+  printf("    GDT Blocks:        %u\n", layout->gdt.blocks);
+  for (UINT32 group = 0; group < layout->groups_count; group++) {
+    Ext2GroupDesc* gd = &layout->gdt.table[group];
+    printf("    Group %2u: inode bitmap %u, block bitmap %u, inode table %u\n",
+           group, gd->inode_bitmap, gd->block_bitmap, gd->inode_table);
+  }
   printf("    Free Blocks:       %d\n", super_block.free_blocks_count);
   printf("    Free Inodes:       %d\n", super_block.free_inodes_count);
+  if (super_block.feature_incompat != 0 || super_block.feature_compat != 0) {
+    printf("    Features:         ");
+    printFeatures(&super_block);
+  }
 
+  freeLayout(disk);
   return SUCCESS;
 }
 
-int initSuperBlock(Ext2SuperBlock* super_block) {
+int initSuperBlock(Ext2SuperBlock* super_block,
+                   UINT32 block_size,
+                   UINT32 blocks_count,
+                   UINT32 inodes_per_group) {
+  UINT32 blocks_per_group = block_size * 8;
+  UINT32 groups_count =
+      (blocks_count + blocks_per_group - 1) / blocks_per_group;
+  UINT32 gdt_blocks = gdtBlocks(groups_count, block_size);
+  // 组内第一个数据块相对组元数据起始块的偏移
+  UINT32 data_offset = 2 + inodes_per_group / (block_size / INODE_SIZE);
+  memset(super_block, 0, sizeof(Ext2SuperBlock));
   super_block->block_group = 0;
-  super_block->blocks_count = NUMBER_OF_BLOCKS;
-  super_block->blocks_per_group = NUMBER_OF_BLOCKS;
+  super_block->inodes_count = inodes_per_group * groups_count;
+  super_block->blocks_count = blocks_count;
+  super_block->blocks_per_group = blocks_per_group;
+  super_block->inodes_per_group = inodes_per_group;
   super_block->inode_size = INODE_SIZE;
   super_block->first_data_block = SUPER_BLOCK_BASE;
-  super_block->first_data_block_each_group = DATA_BLOCK_BASE;
-  super_block->free_blocks_count = NUMBER_OF_BLOCKS - DATA_BLOCK_BASE - 1;
-  super_block->free_inodes_count = NUMBER_OF_INODES - 1;
+  super_block->first_data_block_each_group = data_offset;
+  super_block->free_blocks_count = 0;
+  for (UINT32 group = 0; group < groups_count; group++) {
+    UINT32 meta_base = groupMetaBase(blocks_per_group, gdt_blocks, group);
+    super_block->free_blocks_count +=
+        groupBlocks(blocks_count, blocks_per_group, group) -
+        (meta_base - group * blocks_per_group) - data_offset;
+  }
+  super_block->free_inodes_count = super_block->inodes_count;
   super_block->magic = LINUX;
   super_block->first_ino = 11;
   super_block->errors = 0;
   super_block->log_block_size = 0;
+  while (((UINT32)SECTOR_SIZE << super_block->log_block_size) < block_size) {
+    super_block->log_block_size++;
+  }
   return SUCCESS;
 }
 
+int loadLayout(Disk* disk, Ext2SuperBlock* super_block) {
+  if (disk->layout == NULL) {
+    disk->layout = (Ext2Layout*)malloc(sizeof(Ext2Layout));
+    disk->layout->gdt.table = NULL;
+  }
+  Ext2Layout* layout = disk->layout;
+  layout->super_block = *super_block;
+  layout->meta_dirty = 0;
+  memset(layout->prealloc, 0, sizeof(layout->prealloc));
+  layout->prealloc_victim = 0;
+  memset(layout->delayed, 0, sizeof(layout->delayed));
+  layout->delayed_victim = 0;
+  layout->icache = NULL;
+  layout->dcache = NULL;
+  memset(layout->map_cache, 0, sizeof(layout->map_cache));
+  layout->map_clock = 0;
+  layout->map_hits = 0;
+  layout->map_misses = 0;
+  memset(layout->map_runs, 0, sizeof(layout->map_runs));
+  layout->run_hits = 0;
+  layout->block_size = SECTOR_SIZE << super_block->log_block_size;
+  layout->blocks_count = super_block->blocks_count;
+  layout->inodes_count = super_block->inodes_count;
+  layout->blocks_per_group = super_block->blocks_per_group;
+  layout->inodes_per_group = super_block->inodes_per_group;
+  layout->groups_count =
+      (layout->blocks_count + layout->blocks_per_group - 1) /
+      layout->blocks_per_group;
+  layout->inodes_per_block = layout->block_size / INODE_SIZE;
+  layout->dirs_per_block = layout->block_size / DIR_SIZE;
+  layout->addrs_per_block = layout->block_size / sizeof(UINT32);
+  layout->inode_table_blocks =
+      layout->inodes_per_group / layout->inodes_per_block;
+  if (super_block->feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP) {
+    printf("Unsupported features 0x%x in the super block\n",
+           super_block->feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP);
+    return FAILURE;
+  }
+  if (layout->groups_count == 0 ||
+      GDT_BLOCK_BASE + gdtBlocks(layout->groups_count, layout->block_size) >=
+          layout->blocks_per_group) {
+    printf("Invalid groups count %u in the super block\n",
+           layout->groups_count);
+    return FAILURE;
+  }
+  if (setDiskGeometry(disk, layout->block_size) == FAILURE) {
+    return FAILURE;
+  }
+  // 之后对组描述符的修改都只在内存中进行，由 syncMetadata 写回
+  freeGdt(&layout->gdt);
+  return getGdt(disk, &layout->gdt, layout->groups_count);
+}
+
+void freeLayout(Disk* disk) {
+  if (disk->layout != NULL) {
+    // 没能落盘的延迟写缓冲
+    for (int i = 0; i < EXT2_DELAYED_SLOTS; i++) {
+      free(disk->layout->delayed[i].data);
+    }
+    freeGdt(&disk->layout->gdt);
+    free(disk->layout);
+    disk->layout = NULL;
+  }
+}
+
+// 为 groups_count 个组分配按整块计的组描述符表，未用到的部分清零
+static int allocGdt(Ext2GroupDescTable* gdt,
+                    UINT32 groups_count,
+                    UINT32 block_size) {
+  gdt->groups_count = groups_count;
+  gdt->blocks = gdtBlocks(groups_count, block_size);
+  gdt->table = (Ext2GroupDesc*)calloc(gdt->blocks, block_size);
+  return gdt->table == NULL ? FAILURE : SUCCESS;
+}
+
+void freeGdt(Ext2GroupDescTable* gdt) {
+  free(gdt->table);
+  gdt->table = NULL;
+}
+
 int initGdt(Ext2GroupDescTable* gdt, Ext2SuperBlock* super_block) {
-  Ext2GroupDesc gd;
-  memset(gdt, 0, sizeof(Ext2GroupDescTable));
-  memset(&gd, 0, GD_SIZE);
-
-  gd.block_bitmap = BLOCK_BITMAP_BASE;
-  gd.inode_bitmap = INODE_BITMAP_BASE;
-  gd.free_blocks_count = super_block->free_blocks_count;
-  gd.free_inodes_count = super_block->free_inodes_count;
-  gd.used_dirs_count = 0;
-  memcpy(&gdt->table[0], &gd, GD_SIZE);
+  UINT32 blocks_per_group = super_block->blocks_per_group;
+  UINT32 groups_count =
+      (super_block->blocks_count + blocks_per_group - 1) / blocks_per_group;
+  UINT32 block_size = SECTOR_SIZE << super_block->log_block_size;
+  if (allocGdt(gdt, groups_count, block_size) == FAILURE) {
+    return FAILURE;
+  }
+
+  for (UINT32 group = 0; group < groups_count; group++) {
+    Ext2GroupDesc* gd = &gdt->table[group];
+    UINT32 meta_base = groupMetaBase(blocks_per_group, gdt->blocks, group);
+    // 每个组依次存放 inode 位图、块位图和 inode 表
+    gd->inode_bitmap = meta_base;
+    gd->block_bitmap = meta_base + 1;
+    gd->inode_table = meta_base + 2;
+    gd->free_blocks_count =
+        groupBlocks(super_block->blocks_count, blocks_per_group, group) -
+        (meta_base - group * blocks_per_group) -
+        super_block->first_data_block_each_group;
+    gd->free_inodes_count = super_block->inodes_per_group;
+    gd->used_dirs_count = 0;
+  }
   return SUCCESS;
 }
 
 int initInodeBitmap(Disk* disk) {
-  BYTE bitmap[BLOCK_SIZE];
-  memset(bitmap, 0, BLOCK_SIZE);
-
-  writeInodeBitmap(disk, bitmap);
+  Ext2Layout* layout = disk->layout;
+  BYTE bitmap[MAX_BLOCK_SIZE];
+
+  for (UINT32 group = 0; group < layout->groups_count; group++) {
+    memset(bitmap, 0, layout->block_size);
+    // 超出每组 inode 数的位置设为占用
+    for (UINT32 i = layout->inodes_per_group; i < layout->block_size * 8;
+         i++) {
+      setBit(bitmap, i, 1);
+    }
+    writeInodeBitmap(disk, group, bitmap);
+  }
 
   return SUCCESS;
 }
 
 int initBlockBitmap(Disk* disk) {
-  BYTE bitmap[BLOCK_SIZE];
-  memset(bitmap, 0, BLOCK_SIZE);
-
-  for (int i = 0; i < DATA_BLOCK_BASE; i++) {
-    setBit(bitmap, i, 1);
+  Ext2Layout* layout = disk->layout;
+  BYTE bitmap[MAX_BLOCK_SIZE];
+
+  for (UINT32 group = 0; group < layout->groups_count; group++) {
+    // 组内位图的第 i 位对应第 group * blocks_per_group + i 个块
+    UINT32 group_base = group * layout->blocks_per_group;
+    UINT32 meta_end = layout->gdt.table[group].inode_table +
+                      layout->inode_table_blocks - group_base;
+    UINT32 blocks = groupBlocks(layout->blocks_count, layout->blocks_per_group,
+                                group);
+    memset(bitmap, 0, layout->block_size);
+    // 元数据块和超出本组块数的位置都设为占用
+    for (UINT32 i = 0; i < meta_end; i++) {
+      setBit(bitmap, i, 1);
+    }
+    for (UINT32 i = blocks; i < layout->block_size * 8; i++) {
+      setBit(bitmap, i, 1);
+    }
+    writeBlockBitmap(disk, group, bitmap);
   }
 
-  writeBlockBitmap(disk, bitmap);
-
   return SUCCESS;
 }
 
-int initRootDir(Disk* disk) {
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
+void initInodeMap(Disk* disk, Ext2Inode* inode) {
+  if (disk->layout->super_block.feature_incompat &
+      EXT2_FEATURE_INCOMPAT_EXTENTS) {
+    initExtentTree(inode);
+  }
+}
 
-  // 首先添加一个 inode
+int initRootDir(Disk* disk) {
+  // 首先添加一个 inode，根目录占用第 0 个 inode
   Ext2Inode root_inode;
+  memset(&root_inode, 0, INODE_SIZE);
   root_inode.mode = 0x1FF | 0x4000;
   root_inode.size = 0;
   root_inode.blocks = 0;
+  initInodeMap(disk, &root_inode);
   // inode 所处的位置
-  Ext2Location root_inode_location;
-  root_inode_location.block_idx = INODE_TABLE_BASE;
-  root_inode_location.offset = 0;
+  Ext2Location root_inode_location = getFreeInode(disk, NULL);
 
   // 添加根目录，根目录的上级目录还是自己
   Ext2DirEntry entry;
+  memset(&entry, 0, DIR_SIZE);
   strcpy(entry.name, "..");
   entry.name_len = strlen("..");
   entry.file_type = EXT2_DIR;
@@ -127,33 +403,17 @@ int initRootDir(Disk* disk) {
 
   writeInode(disk, &root_inode, &root_inode_location);
 
-  // 修改 Super Block 的值
-  Ext2SuperBlock super_block;
-  getSuperBlock(disk, &super_block);
-  super_block.free_blocks_count--;
-  writeSuperBlock(disk, &super_block);
-
   // 修改 Group Desc 的值
-  Ext2GroupDescTable gdt;
-  getGdt(disk, &gdt);
-  gdt.table[0].free_blocks_count--;
-  gdt.table[0].used_dirs_count++;
-  gdt.table[0].free_inodes_count--;
-  writeGdt(disk, &gdt);
-
-  // 修改 block 位图
-  setBlockBitmap(disk, DATA_BLOCK_BASE, 1);
-
-  // 修改 inode 位图
-  setInodeBitmap(disk, 0, 1);
+  disk->layout->gdt.table[0].used_dirs_count++;
+  disk->layout->meta_dirty = 1;
 
   return SUCCESS;
 }
 
 int writeSuperBlock(Disk* disk, Ext2SuperBlock* super_block) {
   unsigned int block_idx = SUPER_BLOCK_BASE;
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
+  BYTE block[MAX_BLOCK_SIZE];
+  memset(block, 0, MAX_BLOCK_SIZE);
   memcpy(block, super_block, SUPER_BLOCK_SIZE);
   writeBlock(disk, block_idx, block);
 
@@ -161,30 +421,62 @@ int writeSuperBlock(Disk* disk, Ext2SuperBlock* super_block) {
 }
 
 int getSuperBlock(Disk* disk, Ext2SuperBlock* super_block) {
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
+  BYTE block[MAX_BLOCK_SIZE];
+  memset(block, 0, MAX_BLOCK_SIZE);
   memset(super_block, 0, sizeof(Ext2SuperBlock));
   readBlock(disk, SUPER_BLOCK_BASE, block);
   memcpy(super_block, block, sizeof(Ext2SuperBlock));
   return SUCCESS;
 }
 
+// 组描述符表的每个块对应一个请求，整张表一次批量读写
+static int gdtRequests(Disk* disk,
+                       Ext2GroupDescTable* gdt,
+                       DiskRequest** requests) {
+  *requests = (DiskRequest*)malloc(gdt->blocks * sizeof(DiskRequest));
+  if (*requests == NULL) {
+    return FAILURE;
+  }
+  for (UINT32 i = 0; i < gdt->blocks; i++) {
+    (*requests)[i].block_idx = GDT_BLOCK_BASE + i;
+    (*requests)[i].data = (BYTE*)gdt->table + (size_t)i * disk->block_size;
+  }
+  return SUCCESS;
+}
+
 int writeGdt(Disk* disk, Ext2GroupDescTable* gdt) {
-  unsigned int block_idx = GDT_BLOCK_BASE;
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
+  DiskRequest* requests;
+  if (gdtRequests(disk, gdt, &requests) == FAILURE) {
+    return FAILURE;
+  }
+  int ret = writeBlocks(disk, requests, gdt->blocks);
+  free(requests);
+  return ret;
+}
 
-  memcpy(block, gdt, sizeof(Ext2GroupDescTable));
-  writeBlock(disk, block_idx, block);
-  return SUCCESS;
+int getGdt(Disk* disk, Ext2GroupDescTable* gdt, UINT32 groups_count) {
+  DiskRequest* requests;
+  if (allocGdt(gdt, groups_count, disk->block_size) == FAILURE) {
+    return FAILURE;
+  }
+  if (gdtRequests(disk, gdt, &requests) == FAILURE) {
+    freeGdt(gdt);
+    return FAILURE;
+  }
+  int ret = readBlocks(disk, requests, gdt->blocks);
+  free(requests);
+  return ret;
 }
 
-int getGdt(Disk* disk, Ext2GroupDescTable* gdt) {
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
-  memset(gdt, 0, sizeof(Ext2GroupDescTable));
-  readBlock(disk, GDT_BLOCK_BASE, block);
-  memcpy(gdt, block, sizeof(Ext2GroupDescTable));
+int syncMetadata(Disk* disk) {
+  Ext2Layout* layout = disk->layout;
+  if (layout == NULL || !layout->meta_dirty) {
+    return SUCCESS;
+  }
+  layout->super_block.wtime = time(NULL);
+  writeSuperBlock(disk, &layout->super_block);
+  writeGdt(disk, &layout->gdt);
+  layout->meta_dirty = 0;
   return SUCCESS;
 }
 
@@ -194,12 +486,9 @@ void getRootInode(Disk* disk, Ext2Inode* inode) {
 
 unsigned int getInodeIndex(Disk* disk, Ext2Inode* inode) {
   Ext2DirEntry entry;
-  BYTE block[BLOCK_SIZE];
-  unsigned int items = inode->size / DIR_SIZE;
-  for (unsigned int i = 0; i < items; i++) {
-    Ext2Location dir_location = getDirEntryLocation(disk, i, inode);
-    readBlock(disk, dir_location.block_idx, block);
-    memcpy(&entry, block + dir_location.offset, DIR_SIZE);
+  Ext2DirIter iter;
+  dirIterInit(&iter, disk, inode, 0);
+  while (dirIterNext(&iter, &entry, NULL) == SUCCESS) {
     if (!strcmp(entry.name, ".")) {
       return entry.inode;
     }
@@ -207,9 +496,55 @@ unsigned int getInodeIndex(Disk* disk, Ext2Inode* inode) {
   return 0;
 }
 
+Ext2Location getInodeLocation(Disk* disk, unsigned int index) {
+  Ext2Layout* layout = disk->layout;
+  Ext2Location location;
+  // 先找到 inode 所在的组，再在该组的 inode 表中定位
+  unsigned int group = index / layout->inodes_per_group;
+  unsigned int local = index % layout->inodes_per_group;
+  location.block_idx =
+      layout->gdt.table[group].inode_table + local / layout->inodes_per_block;
+  location.offset = (local % layout->inodes_per_block) * INODE_SIZE;
+  return location;
+}
+
+// 由 inode 表中的位置反推 inode 序号，位置不对应任何 inode 时返回 -1
+static unsigned int locationToInode(Disk* disk, Ext2Location* location) {
+  Ext2Layout* layout = disk->layout;
+  if (location->offset % INODE_SIZE != 0 ||
+      location->offset >= layout->block_size) {
+    return (unsigned int)-1;
+  }
+  for (UINT32 group = 0; group < layout->groups_count; group++) {
+    UINT32 table = layout->gdt.table[group].inode_table;
+    if (location->block_idx >= table &&
+        location->block_idx < table + layout->inode_table_blocks) {
+      unsigned int local =
+          (location->block_idx - table) * layout->inodes_per_block +
+          location->offset / INODE_SIZE;
+      if (local >= layout->inodes_per_group) {
+        return (unsigned int)-1;
+      }
+      return group * layout->inodes_per_group + local;
+    }
+  }
+  return (unsigned int)-1;
+}
+
 int writeInode(Disk* disk, Ext2Inode* inode, Ext2Location* location) {
-  BYTE block[BLOCK_SIZE];
+  BYTE block[MAX_BLOCK_SIZE];
+  // 失败的 getFreeInode 返回的 -1 或过期的位置不能写，否则会覆盖别的 inode
+  unsigned int inode_idx = locationToInode(disk, location);
+  if (inode_idx == (unsigned int)-1) {
+    printf("Error : invalid inode location %u:%u!\n", location->block_idx,
+           location->offset);
+    return FAILURE;
+  }
   inode->mtime = time(NULL);
+  if (disk->layout->icache != NULL) {
+    // 挂载期间只修改缓存中的副本，sync 时再写回 inode 表
+    return cacheWriteInode(disk->layout->icache, disk, inode_idx, inode);
+  }
   readBlock(disk, location->block_idx, block);
   memcpy(block + location->offset, inode, INODE_SIZE);
   writeBlock(disk, location->block_idx, block);
@@ -218,47 +553,57 @@ int writeInode(Disk* disk, Ext2Inode* inode, Ext2Location* location) {
 }
 
 int getInode(Disk* disk, unsigned int index, Ext2Inode* inode) {
-  BYTE block[BLOCK_SIZE];
-  memset(block, 0, BLOCK_SIZE);
+  if (disk->layout->icache != NULL) {
+    return cacheReadInode(disk->layout->icache, disk, index, inode);
+  }
+  BYTE block[MAX_BLOCK_SIZE];
+  memset(block, 0, MAX_BLOCK_SIZE);
   memset(inode, 0, INODE_SIZE);
 
-  unsigned int inode_block = INODE_TABLE_BASE + index / INODES_PER_BLOCK;
-  unsigned int inode_offset = (index % INODES_PER_BLOCK) * INODE_SIZE;
+  Ext2Location location = getInodeLocation(disk, index);
 
-  readBlock(disk, inode_block, block);
-  memcpy(inode, block + inode_offset, INODE_SIZE);
+  readBlock(disk, location.block_idx, block);
+  memcpy(inode, block + location.offset, INODE_SIZE);
   return SUCCESS;
 }
 
-Ext2Location getFreeInode(Disk* disk) {
+UINT64 getInodeSize(Ext2Inode* inode) {
+  return ((UINT64)inode->size_high << 32) | inode->size;
+}
+
+void setInodeSize(Ext2Inode* inode, UINT64 size) {
+  inode->size = (UINT32)size;
+  inode->size_high = (UINT32)(size >> 32);
+}
+
+Ext2Location getFreeInode(Disk* disk, unsigned int* inode_idx) {
+  Ext2Layout* layout = disk->layout;
   Ext2Location location;
-  Ext2SuperBlock super_block;
-  Ext2GroupDescTable gdt;
-  // 读取 inode 位图
-  BYTE block[BLOCK_SIZE];
-  readBlock(disk, INODE_BITMAP_BASE, block);
-  for (int i = 0; i < NUMBER_OF_INODES / 8; i++) {
-    if (block[i] != 0xff) {
-      // 找到可用空位
-      unsigned int offset = getOffset(block[i]);
-      block[i] |= (0x80 >> offset);
-      // 更新 inode 位图
-      writeBlock(disk, INODE_BITMAP_BASE, block);
-      // 修改文件系统信息
-      // 更新 Super Block 信息
-      getSuperBlock(disk, &super_block);
-      super_block.free_inodes_count--;
-      writeSuperBlock(disk, &super_block);
-      // 更新 Group Desc 信息
-      getGdt(disk, &gdt);
-      gdt.table[0].free_inodes_count--;
-      writeGdt(disk, &gdt);
-      // 得到 inode 的序号
-      unsigned int loc = i * 8 + offset;
-      location.block_idx = INODE_TABLE_BASE + (loc * INODE_SIZE) / BLOCK_SIZE;
-      location.offset = (loc * INODE_SIZE) % BLOCK_SIZE;
-      return location;
+  BYTE bitmap[MAX_BLOCK_SIZE];
+  for (UINT32 group = 0; group < layout->groups_count; group++) {
+    // 根据组描述符跳过已满的组，不必读取它的位图
+    if (layout->gdt.table[group].free_inodes_count == 0) {
+      continue;
+    }
+    // 读取本组的 inode 位图，按字查找空位
+    getInodeBitmap(disk, group, bitmap);
+    int bit = findFirstZeroBit(bitmap, layout->inodes_per_group);
+    if (bit < 0) {
+      continue;
+    }
+    setBit(bitmap, bit, 1);
+    // 更新 inode 位图
+    writeInodeBitmap(disk, group, bitmap);
+    // 修改文件系统信息，只更新内存中的计数
+    layout->super_block.free_inodes_count--;
+    layout->gdt.table[group].free_inodes_count--;
+    layout->meta_dirty = 1;
+    // 得到 inode 的序号
+    unsigned int index = group * layout->inodes_per_group + bit;
+    if (inode_idx != NULL) {
+      *inode_idx = index;
     }
+    return getInodeLocation(disk, index);
   }
   // 错误处理
   location.block_idx = -1;
@@ -267,34 +612,65 @@ Ext2Location getFreeInode(Disk* disk) {
 }
 
 Ext2Location getFreeBlock(Disk* disk) {
+  unsigned int got;
+  return allocBlocks(disk, 0, 1, &got);
+}
+
+Ext2Location allocBlocks(Disk* disk,
+                         unsigned int goal,
+                         unsigned int count,
+                         unsigned int* got) {
+  Ext2Layout* layout = disk->layout;
+  Ext2SuperBlock* super_block = &layout->super_block;
   Ext2Location location;
-  Ext2SuperBlock super_block;
-  Ext2GroupDescTable gdt;
-  // 读取 block 位图
-  BYTE bitmap[BLOCK_SIZE];
-  getBlockBitmap(disk, bitmap);
-  for (int i = 0; i < NUMBER_OF_BLOCKS / 8; i++) {
-    if (bitmap[i] != 0xff) {
-      // 找到可用空位
-      unsigned int offset = getOffset(bitmap[i]);
-      bitmap[i] |= (0x80 >> offset);
-      // 更新 block 位图
-      writeBlockBitmap(disk, bitmap);
-      // 修改文件系统信息
-      // 更新 Super Block
-      getSuperBlock(disk, &super_block);
-      super_block.free_blocks_count--;
-      writeSuperBlock(disk, &super_block);
-      // 更新 Group Desc
-      getGdt(disk, &gdt);
-      gdt.table[0].free_blocks_count--;
-      writeGdt(disk, &gdt);
-      // 得到空闲 block 的序号
-      unsigned int loc = i * 8 + offset;
-      location.block_idx = DATA_BLOCK_BASE + loc;
-      location.offset = 0;
-      return location;
+  BYTE bitmap[MAX_BLOCK_SIZE];
+  // 有目标块时从目标块开始查找，否则从上次分配的组和位置继续 (next-fit)
+  UINT32 start_group, start_bit;
+  if (goal != 0 && goal < layout->blocks_count) {
+    start_group = goal / layout->blocks_per_group;
+    start_bit = goal % layout->blocks_per_group;
+  } else {
+    start_group = super_block->alloc_group < layout->groups_count
+                      ? super_block->alloc_group
+                      : 0;
+    start_bit = layout->gdt.table[start_group].alloc_cursor;
+  }
+  *got = 0;
+  for (UINT32 i = 0; i < layout->groups_count; i++) {
+    UINT32 group = (start_group + i) % layout->groups_count;
+    // 根据组描述符跳过已满的组，不必读取它的位图
+    if (layout->gdt.table[group].free_blocks_count == 0) {
+      continue;
+    }
+    // 读取本组的 block 位图，位图的第 i 位对应组内第 i 个块
+    getBlockBitmap(disk, group, bitmap);
+    UINT32 from = group == start_group
+                      ? start_bit
+                      : layout->gdt.table[group].alloc_cursor;
+    unsigned int run;
+    int bit = findZeroRun(
+        bitmap, from,
+        groupBlocks(layout->blocks_count, layout->blocks_per_group, group),
+        count, &run);
+    if (bit < 0) {
+      continue;
+    }
+    for (unsigned int j = 0; j < run; j++) {
+      setBit(bitmap, bit + j, 1);
     }
+    // 整段只写一次 block 位图
+    writeBlockBitmap(disk, group, bitmap);
+    // 修改文件系统信息，只更新内存中的计数，游标随组描述符一起写回
+    super_block->free_blocks_count -= run;
+    super_block->alloc_group = group;
+    layout->gdt.table[group].alloc_cursor = bit + run;
+    layout->gdt.table[group].free_blocks_count -= run;
+    layout->meta_dirty = 1;
+    // 得到第一个空闲 block 的序号
+    *got = run;
+    location.block_idx = group * layout->blocks_per_group + bit;
+    location.offset = 0;
+    return location;
   }
   // 错误处理
   location.block_idx = -1;
@@ -303,72 +679,161 @@ Ext2Location getFreeBlock(Disk* disk) {
 }
 
 int freeBlock(Disk* disk, int index) {
-  // 删除 block 并更新 superblock 和 group desc
-  Ext2SuperBlock super_block;
-  Ext2GroupDescTable gdt;
+  // 删除 block 并更新内存中 superblock 和 group desc 的计数
+  Ext2Layout* layout = disk->layout;
+  UINT32 group = index / layout->blocks_per_group;
   setBlockBitmap(disk, index, 0);
-  getSuperBlock(disk, &super_block);
-  getGdt(disk, &gdt);
-  super_block.free_blocks_count++;
-  gdt.table[0].free_blocks_count++;
-  writeSuperBlock(disk, &super_block);
-  writeGdt(disk, &gdt);
+  forgetIndexBlocks(disk, index, 1);
+  layout->super_block.free_blocks_count++;
+  layout->gdt.table[group].free_blocks_count++;
+  layout->meta_dirty = 1;
+  return SUCCESS;
+}
+
+int freeBlocks(Disk* disk, unsigned int start, unsigned int count) {
+  // 一段连续的块可能跨越组的边界，每个组的位图只读写一次
+  Ext2Layout* layout = disk->layout;
+  BYTE bitmap[MAX_BLOCK_SIZE];
+  forgetIndexBlocks(disk, start, count);
+  while (count > 0) {
+    UINT32 group = start / layout->blocks_per_group;
+    UINT32 bit = start % layout->blocks_per_group;
+    UINT32 n = layout->blocks_per_group - bit;
+    if (n > count) {
+      n = count;
+    }
+    getBlockBitmap(disk, group, bitmap);
+    for (UINT32 i = 0; i < n; i++) {
+      setBit(bitmap, bit + i, 0);
+    }
+    writeBlockBitmap(disk, group, bitmap);
+    layout->super_block.free_blocks_count += n;
+    layout->gdt.table[group].free_blocks_count += n;
+    layout->meta_dirty = 1;
+    start += n;
+    count -= n;
+  }
   return SUCCESS;
 }
 
+// 找到紧跟在 prev 之后的预分配窗口
+static Ext2Prealloc* findPrealloc(Ext2Layout* layout, unsigned int prev) {
+  for (int i = 0; i < EXT2_PREALLOC_SLOTS; i++) {
+    Ext2Prealloc* window = &layout->prealloc[i];
+    if (window->count > 0 && window->start == prev + 1) {
+      return window;
+    }
+  }
+  return NULL;
+}
+
+Ext2Location allocFileBlocks(Disk* disk,
+                             unsigned int prev,
+                             unsigned int count,
+                             unsigned int* got) {
+  Ext2Layout* layout = disk->layout;
+  Ext2Location location;
+  // 先使用紧跟在最后一块之后的预分配窗口
+  Ext2Prealloc* window = prev != 0 ? findPrealloc(layout, prev) : NULL;
+  if (window != NULL) {
+    *got = count < window->count ? count : window->count;
+    location.block_idx = window->start;
+    location.offset = 0;
+    window->start += *got;
+    window->count -= *got;
+    return location;
+  }
+  // 没有窗口时多分配 EXT2_PREALLOC_BLOCKS 块，多出的部分留作新窗口
+  unsigned int run;
+  location = allocBlocks(disk, prev != 0 ? prev + 1 : 0,
+                         count + EXT2_PREALLOC_BLOCKS, &run);
+  *got = run < count ? run : count;
+  if (run > *got) {
+    // 窗口已满时替换最早建立的窗口
+    window = &layout->prealloc[layout->prealloc_victim];
+    layout->prealloc_victim =
+        (layout->prealloc_victim + 1) % EXT2_PREALLOC_SLOTS;
+    if (window->count > 0) {
+      freeBlocks(disk, window->start, window->count);
+    }
+    window->start = location.block_idx + *got;
+    window->count = run - *got;
+  }
+  return location;
+}
+
+void releasePrealloc(Disk* disk, unsigned int prev) {
+  Ext2Prealloc* window = findPrealloc(disk->layout, prev);
+  if (window != NULL) {
+    freeBlocks(disk, window->start, window->count);
+    window->count = 0;
+  }
+}
+
+void releaseAllPrealloc(Disk* disk) {
+  Ext2Layout* layout = disk->layout;
+  for (int i = 0; i < EXT2_PREALLOC_SLOTS; i++) {
+    if (layout->prealloc[i].count > 0) {
+      freeBlocks(disk, layout->prealloc[i].start, layout->prealloc[i].count);
+      layout->prealloc[i].count = 0;
+    }
+  }
+}
+
 int freeInode(Disk* disk, int index) {
-  // 删除 inode 并更新 superblock 和 group desc
-  Ext2SuperBlock super_block;
-  Ext2GroupDescTable gdt;
+  // 删除 inode 并更新内存中 superblock 和 group desc 的计数
+  Ext2Layout* layout = disk->layout;
+  UINT32 group = index / layout->inodes_per_group;
   setInodeBitmap(disk, index, 0);
-  getSuperBlock(disk, &super_block);
-  getGdt(disk, &gdt);
-  super_block.free_inodes_count++;
-  gdt.table[0].free_inodes_count++;
-  writeSuperBlock(disk, &super_block);
-  writeGdt(disk, &gdt);
+  if (layout->icache != NULL) {
+    forgetInode(layout->icache, index);
+  }
+  layout->super_block.free_inodes_count++;
+  layout->gdt.table[group].free_inodes_count++;
+  layout->meta_dirty = 1;
   return SUCCESS;
 }
 
+UINT32 mapFileBlock(Disk* disk,
+                    Ext2Inode* inode,
+                    UINT32 logical,
+                    UINT32* run) {
+  if (run != NULL) {
+    *run = 1;
+  }
+  if (inode->flags & EXT2_EXTENTS_FL) {
+    return extentMapBlock(disk, inode, logical, run);
+  }
+  return indirectMapBlock(disk, inode, logical, run);
+}
+
+int appendFileBlocks(Disk* disk,
+                     Ext2Inode* inode,
+                     UINT32 logical,
+                     UINT32 start,
+                     UINT32 count) {
+  if (inode->flags & EXT2_EXTENTS_FL) {
+    return extentAppend(disk, inode, logical, start, count);
+  }
+  return indirectAppend(disk, inode, logical, start, count);
+}
+
+int truncateFileBlocks(Disk* disk, Ext2Inode* inode, UINT32 blocks) {
+  if (inode->flags & EXT2_EXTENTS_FL) {
+    return extentTruncate(disk, inode, blocks);
+  }
+  return indirectTruncate(disk, inode, blocks);
+}
+
 Ext2Location getDirEntryLocation(Disk* disk,
                                  unsigned int index,
                                  Ext2Inode* parent) {
-  UINT32* block = parent->block;
+  Ext2Layout* layout = disk->layout;
   Ext2Location location;
-  BYTE tmp_block[BLOCK_SIZE];
-  unsigned int num;
-  unsigned int dir_block = index / DIRS_PER_BLOCK;
-  unsigned int dir_offset = index % DIRS_PER_BLOCK;
-  location.offset = dir_offset * DIR_SIZE;
-  if (dir_block < 6) {
-    // 直接寻址
-    location.block_idx = block[dir_block];
-    return location;
-  } else {
-    // 间接寻址
-    dir_block = dir_block - 6;
-    if (dir_block < BLOCK_SIZE / 4) {
-      // 一级索引
-      // 一个 block 512 字节，一个 int 4 个字节，所以一个 block 可以存储 128
-      // 个 block
-      readBlock(disk, block[6], tmp_block);
-      memcpy(&num, tmp_block + dir_block * sizeof(unsigned int),
-             sizeof(unsigned int));
-      location.block_idx = num;
-      return location;
-    } else {
-      // 二级索引
-      dir_block = dir_block - BLOCK_SIZE / 4;
-      unsigned int block_offset = dir_block / DIRS_PER_BLOCK;
-      readBlock(disk, block[7], tmp_block);
-      memcpy(&num, tmp_block + block_offset * sizeof(unsigned int),
-             sizeof(unsigned int));
-      readBlock(disk, num, tmp_block);
-      memcpy(&num, tmp_block + dir_offset, sizeof(unsigned int));
-      location.block_idx = num;
-      return location;
-    }
-  }
+  location.offset = index % layout->dirs_per_block * DIR_SIZE;
+  location.block_idx =
+      mapFileBlock(disk, parent, index / layout->dirs_per_block, NULL);
+  return location;
 }
 
 int getDirEntry(Disk* disk,
@@ -376,7 +841,7 @@ int getDirEntry(Disk* disk,
                 Ext2Inode* parent,
                 Ext2DirEntry* entry) {
   assert(entry != NULL);
-  BYTE block[BLOCK_SIZE];
+  BYTE block[MAX_BLOCK_SIZE];
   Ext2Location dir_location = getDirEntryLocation(disk, index, parent);
   readBlock(disk, dir_location.block_idx, block);
   memcpy(entry, block + dir_location.offset, DIR_SIZE);
@@ -388,7 +853,7 @@ int writeDirEntry(Disk* disk,
                   Ext2Inode* parent,
                   Ext2DirEntry* entry) {
   assert(entry != NULL);
-  BYTE block[BLOCK_SIZE];
+  BYTE block[MAX_BLOCK_SIZE];
   Ext2Location dir_location = getDirEntryLocation(disk, index, parent);
   readBlock(disk, dir_location.block_idx, block);
   memcpy(block + dir_location.offset, entry, DIR_SIZE);
@@ -396,6 +861,63 @@ int writeDirEntry(Disk* disk,
   return SUCCESS;
 }
 
+void dirIterInit(Ext2DirIter* iter,
+                 Disk* disk,
+                 Ext2Inode* dir,
+                 unsigned int start) {
+  iter->disk = disk;
+  iter->dir = dir;
+  iter->items = dir->size / DIR_SIZE;
+  iter->next = start;
+  iter->first = 0;
+  iter->count = 0;
+}
+
+// 从 next 所在的块开始批量读入若干个目录块
+static int dirIterFill(Ext2DirIter* iter) {
+  Ext2Layout* layout = iter->disk->layout;
+  unsigned int dpb = layout->dirs_per_block;
+  unsigned int first_block = iter->next / dpb;
+  unsigned int last_block = (iter->items + dpb - 1) / dpb;
+  unsigned int count = last_block - first_block;
+  if (count > EXT2_DIR_ITER_BLOCKS) {
+    count = EXT2_DIR_ITER_BLOCKS;
+  }
+  DiskRequest requests[EXT2_DIR_ITER_BLOCKS];
+  for (unsigned int i = 0; i < count; i++) {
+    requests[i].block_idx =
+        mapFileBlock(iter->disk, iter->dir, first_block + i, NULL);
+    requests[i].data = iter->blocks + i * layout->block_size;
+  }
+  if (readBlocks(iter->disk, requests, count) == FAILURE) {
+    return FAILURE;
+  }
+  iter->first = first_block * dpb;
+  iter->count = count * dpb;
+  if (iter->first + iter->count > iter->items) {
+    iter->count = iter->items - iter->first;
+  }
+  return SUCCESS;
+}
+
+int dirIterNext(Ext2DirIter* iter, Ext2DirEntry* entry, unsigned int* index) {
+  if (iter->next >= iter->items) {
+    return FAILURE;
+  }
+  if (iter->next < iter->first || iter->next >= iter->first + iter->count) {
+    if (dirIterFill(iter) == FAILURE) {
+      return FAILURE;
+    }
+  }
+  memcpy(entry, iter->blocks + (iter->next - iter->first) * DIR_SIZE,
+         DIR_SIZE);
+  if (index != NULL) {
+    *index = iter->next;
+  }
+  iter->next++;
+  return SUCCESS;
+}
+
 int getCurrentEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry) {
   return getDirEntry(disk, 1, inode, entry);
 }
@@ -409,19 +931,143 @@ int writeParentEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry) {
   return writeDirEntry(disk, 0, inode, entry);
 }
 
-int writeFile(Disk* disk, Ext2Inode* inode) {
+// 为文件的 size 字节数据选定物理块并写入，原有的块原地覆盖
+// 文件变长时从最后一块之后继续分配到 count 块，优先使用预分配窗口
+static int growFileBlocks(Disk* disk, Ext2Inode* inode, UINT32 count) {
+  while (inode->blocks < count) {
+    unsigned int got;
+    unsigned int prev =
+        inode->blocks > 0 ? mapFileBlock(disk, inode, inode->blocks - 1, NULL)
+                          : 0;
+    Ext2Location location =
+        allocFileBlocks(disk, prev, count - inode->blocks, &got);
+    if (got == 0) {
+      printf("No free blocks left\n");
+      return FAILURE;
+    }
+    // 使用 extent 时一段连续的块只占一个 extent
+    if (appendFileBlocks(disk, inode, inode->blocks, location.block_idx,
+                         got) == FAILURE) {
+      truncateFileBlocks(disk, inode, inode->blocks);
+      freeBlocks(disk, location.block_idx, got);
+      printf("No free blocks left\n");
+      return FAILURE;
+    }
+    inode->blocks += got;
+  }
+  return SUCCESS;
+}
+
+static int writeFileBlocks(Disk* disk,
+                           Ext2Inode* inode,
+                           BYTE* data,
+                           unsigned int size) {
+  Ext2Layout* layout = disk->layout;
+  unsigned int count = (size + layout->block_size - 1) / layout->block_size;
+  // 文件变短时释放多出的块和其后的预分配窗口
+  if (count < inode->blocks) {
+    releasePrealloc(disk, mapFileBlock(disk, inode, inode->blocks - 1, NULL));
+    truncateFileBlocks(disk, inode, count);
+    inode->blocks = count;
+  }
+  // 空间不足时仍写入已分配到的部分，文件大小随之截短，但要报告失败
+  int ret = growFileBlocks(disk, inode, count);
+  // 再把整个文件一次批量写入，连续的一段块只查一次映射
+  DiskRequest* requests =
+      (DiskRequest*)malloc((size_t)inode->blocks * sizeof(DiskRequest));
+  if (requests == NULL) {
+    printf("Out of memory\n");
+    return FAILURE;
+  }
+  for (UINT64 i = 0; i < inode->blocks;) {
+    UINT32 run;
+    UINT32 block_idx = mapFileBlock(disk, inode, (UINT32)i, &run);
+    for (UINT32 j = 0; j < run && i < inode->blocks; j++, i++) {
+      requests[i].block_idx = block_idx + j;
+      requests[i].data = data + (size_t)i * layout->block_size;
+    }
+  }
+  if (writeBlocks(disk, requests, inode->blocks) == FAILURE) {
+    ret = FAILURE;
+  }
+  free(requests);
+  UINT64 capacity = (UINT64)inode->blocks * layout->block_size;
+  setInodeSize(inode, size < capacity ? size : capacity);
+  return ret;
+}
+
+static Ext2DelayedWrite* findDelayedWrite(Ext2Layout* layout,
+                                          unsigned int inode_idx) {
+  for (int i = 0; i < EXT2_DELAYED_SLOTS; i++) {
+    if (layout->delayed[i].data != NULL &&
+        layout->delayed[i].inode_idx == inode_idx) {
+      return &layout->delayed[i];
+    }
+  }
+  return NULL;
+}
+
+// 把一个延迟写缓冲落到磁盘上，此时才为文件分配块。失败时已分配的块仍记录
+// 在 inode 中，缓冲保留下来，下次 sync 时整个文件重新写一遍
+static int flushDelayedWrite(Disk* disk, Ext2DelayedWrite* delayed) {
+  Ext2Inode inode;
+  getInode(disk, delayed->inode_idx, &inode);
+  int ret = writeFileBlocks(disk, &inode, delayed->data, delayed->size);
+  Ext2Location location = getInodeLocation(disk, delayed->inode_idx);
+  writeInode(disk, &inode, &location);
+  if (ret == SUCCESS) {
+    free(delayed->data);
+    delayed->data = NULL;
+  }
+  return ret;
+}
+
+int flushDelayedWrites(Disk* disk) {
+  Ext2Layout* layout = disk->layout;
+  if (layout == NULL) {
+    return SUCCESS;
+  }
+  int ret = SUCCESS;
+  for (int i = 0; i < EXT2_DELAYED_SLOTS; i++) {
+    if (layout->delayed[i].data != NULL &&
+        flushDelayedWrite(disk, &layout->delayed[i]) == FAILURE) {
+      ret = FAILURE;
+    }
+  }
+  return ret;
+}
+
+void dropDelayedWrite(Disk* disk, unsigned int inode_idx) {
+  Ext2DelayedWrite* delayed = findDelayedWrite(disk->layout, inode_idx);
+  if (delayed != NULL) {
+    free(delayed->data);
+    delayed->data = NULL;
+  }
+}
+
+int writeFile(Disk* disk, unsigned int inode_idx, Ext2Inode* inode) {
   printf("Please input something, type <Esc> to stop writing.\n");
-  BYTE buffer[BLOCK_SIZE];
-  memset(buffer, 0, BLOCK_SIZE);
-  int cursor = 0;
+  Ext2Layout* layout = disk->layout;
+  // 缓冲先按直接索引的大小分配，之后按需扩大
+  unsigned int capacity = EXT2_NDIR_BLOCKS * layout->block_size;
+  BYTE* buffer = (BYTE*)calloc(EXT2_NDIR_BLOCKS, layout->block_size);
+  unsigned int cursor = 0;
 
   char str = getCh();
   while (str != 27) {
     printf("%c", str);
-    // if (!(inode->size %512) {
-    // TODO 扩容
-    // }
-    memcpy(buffer + (cursor++), &str, sizeof(char));
+    // 延迟写缓冲的大小是 32 位的，到上限后不再扩大
+    if (cursor == capacity && capacity <= UINT32_MAX / 2) {
+      BYTE* larger = (BYTE*)realloc(buffer, (size_t)capacity * 2);
+      if (larger != NULL) {
+        memset(larger + capacity, 0, capacity);
+        buffer = larger;
+        capacity *= 2;
+      }
+    }
+    if (cursor < capacity) {
+      memcpy(buffer + (cursor++), &str, sizeof(char));
+    }
     if (str == 0x0d)
       printf("%c", 0x0a);
     str = getCh();
@@ -430,157 +1076,391 @@ int writeFile(Disk* disk, Ext2Inode* inode) {
   }
   printf("\n");
 
-  // 将block加入 inode
-  Ext2Location location = getFreeBlock(disk);
-  writeBlock(disk, location.block_idx, buffer);
-  inode->blocks++;
-  inode->block[0] = location.block_idx;
-  inode->size = cursor;
+  // 数据先留在内存中，到 sync 或卸载时文件大小确定了再分配块
+  Ext2DelayedWrite* delayed = findDelayedWrite(layout, inode_idx);
+  if (delayed != NULL) {
+    free(delayed->data);
+  } else {
+    // 没有空闲的缓冲时先把最早的一个落盘
+    delayed = &layout->delayed[layout->delayed_victim];
+    layout->delayed_victim = (layout->delayed_victim + 1) % EXT2_DELAYED_SLOTS;
+    if (delayed->data != NULL &&
+        flushDelayedWrite(disk, delayed) == FAILURE) {
+      // 最早的缓冲落不了盘时保留它，新内容直接分配块写入
+      int ret = writeFileBlocks(disk, inode, buffer, cursor);
+      free(buffer);
+      inode->mtime = time(NULL);
+      return ret;
+    }
+    delayed->inode_idx = inode_idx;
+  }
+  delayed->data = buffer;
+  delayed->size = cursor;
+  setInodeSize(inode, cursor);
   inode->mtime = time(NULL);
   return SUCCESS;
 }
 
-int readFile(Disk* disk, Ext2Inode* inode) {
-  BYTE block[BLOCK_SIZE];
-  if (inode->size == 0) {
+int readFile(Disk* disk, unsigned int inode_idx, Ext2Inode* inode) {
+  if (getInodeSize(inode) == 0) {
     // 文件为空
     printf("%%empty%%\n");
     return SUCCESS;
   }
-  for (int i = 0; i < inode->blocks; i++) {
+  // 还没有落盘的数据直接从延迟写缓冲中读取
+  Ext2DelayedWrite* delayed = findDelayedWrite(disk->layout, inode_idx);
+  if (delayed != NULL) {
+    printf("%.*s\n", delayed->size, (char*)delayed->data);
+    return SUCCESS;
+  }
+  // 先收集所有数据块的位置，再一次性批量读取
+  Ext2Layout* layout = disk->layout;
+  UINT64 bytes = (UINT64)inode->blocks * layout->block_size;
+  if (bytes > SIZE_MAX) {
+    printf("The file is too large to read at once\n");
+    return FAILURE;
+  }
+  BYTE* buffer = (BYTE*)malloc((size_t)bytes);
+  DiskRequest* requests =
+      (DiskRequest*)malloc((size_t)inode->blocks * sizeof(DiskRequest));
+  if (buffer == NULL || requests == NULL) {
+    printf("The file is too large to read at once\n");
+    free(requests);
+    free(buffer);
+    return FAILURE;
+  }
+  for (UINT64 i = 0; i < inode->blocks;) {
+    // 连续的一段块只需要查一次映射
+    UINT32 run;
+    UINT32 block_idx = mapFileBlock(disk, inode, (UINT32)i, &run);
+    for (UINT32 j = 0; j < run && i < inode->blocks; j++, i++) {
+      requests[i].block_idx = block_idx + j;
+      requests[i].data = buffer + (size_t)i * layout->block_size;
+    }
+  }
+  readBlocks(disk, requests, inode->blocks);
+  for (UINT64 i = 0; i < inode->blocks; i++) {
     // 将所有 block 中的内容输出
-    Ext2Location block_loc = getDirEntryLocation(disk, i * 16, inode);
-    readBlock(disk, block_loc.block_idx, block);
-    printf("%s", block);
+    printf("%.*s", layout->block_size, (char*)requests[i].data);
   }
   printf("\n");
+  free(requests);
+  free(buffer);
   return SUCCESS;
 }
 
-unsigned int addDirEntry(Disk* disk,
-                         Ext2Inode* parent_inode,
-                         Ext2DirEntry* entry) {
-  BYTE block[BLOCK_SIZE];
-  unsigned int total = parent_inode->size / DIR_SIZE;
-  unsigned int dir_block = total / DIRS_PER_BLOCK;
-  unsigned int dir_offset = total % DIRS_PER_BLOCK;
-  if (dir_block < 6) {
-    // 直接索引
-    if (parent_inode->blocks < dir_block + 1) {
-      // 如果没有创建新的 block
-      Ext2Location block_location = getFreeBlock(disk);
-      parent_inode->block[dir_block] = block_location.block_idx;
-      parent_inode->blocks++;
+// 为文件中 [offset, offset + size) 这段数据逐块建立请求。整块直接读写 data，
+// 开头和结尾不满一块的部分改用整块大小的 head 和 tail 中转，返回请求数
+static UINT32 fileRangeRequests(Disk* disk,
+                                Ext2Inode* inode,
+                                UINT64 offset,
+                                UINT32 size,
+                                BYTE* data,
+                                BYTE* head,
+                                BYTE* tail,
+                                DiskRequest* requests) {
+  UINT32 block_size = disk->layout->block_size;
+  UINT32 first = (UINT32)(offset / block_size);
+  UINT32 skip = (UINT32)(offset % block_size);
+  UINT32 n = (UINT32)((offset + size + block_size - 1) / block_size) - first;
+  for (UINT32 k = 0; k < n;) {
+    UINT32 run;
+    UINT32 block_idx = mapFileBlock(disk, inode, first + k, &run);
+    for (UINT32 j = 0; j < run && k < n; j++, k++) {
+      // 第 k 块从 data 中的 start 处开始，只有第一块的 start 可能为负
+      long long start = (long long)k * block_size - skip;
+      requests[k].block_idx = block_idx + j;
+      if (start < 0) {
+        requests[k].data = head;
+      } else if (start + block_size > size) {
+        requests[k].data = tail;
+      } else {
+        requests[k].data = data + start;
+      }
     }
-    readBlock(disk, parent_inode->block[dir_block], block);
-    memcpy(block + dir_offset * DIR_SIZE, entry, DIR_SIZE);
-    writeBlock(disk, parent_inode->block[dir_block], block);
-    parent_inode->size += DIR_SIZE;
-    return SUCCESS;
+  }
+  return n;
+}
+
+int appendFile(Disk* disk,
+               unsigned int inode_idx,
+               Ext2Inode* inode,
+               BYTE* data,
+               UINT32 size) {
+  Ext2Layout* layout = disk->layout;
+  // 延迟写缓冲中的内容先落盘，追加的数据接在它后面
+  Ext2DelayedWrite* delayed = findDelayedWrite(layout, inode_idx);
+  if (delayed != NULL) {
+    int ret = flushDelayedWrite(disk, delayed);
+    getInode(disk, inode_idx, inode);
+    if (ret == FAILURE) {
+      return FAILURE;
+    }
+  }
+  UINT32 block_size = layout->block_size;
+  UINT64 offset = getInodeSize(inode);
+  UINT64 count = (offset + size + block_size - 1) / block_size;
+  if (count > UINT32_MAX) {
+    printf("The file is too large\n");
+    return FAILURE;
+  }
+  // 空间不够时只写入已经分配到的部分
+  int ret = growFileBlocks(disk, inode, (UINT32)count);
+  UINT64 capacity = (UINT64)inode->blocks * block_size;
+  if (offset + size > capacity) {
+    size = (UINT32)(capacity - offset);
+  }
+  if (size == 0) {
+    return ret;
+  }
+  BYTE* head = (BYTE*)calloc(2, block_size);
+  DiskRequest* requests =
+      (DiskRequest*)malloc(((size_t)size / block_size + 2) *
+                           sizeof(DiskRequest));
+  if (head == NULL || requests == NULL) {
+    printf("Out of memory\n");
+    free(requests);
+    free(head);
+    return FAILURE;
+  }
+  BYTE* tail = head + block_size;
+  UINT32 n = fileRangeRequests(disk, inode, offset, size, data, head, tail,
+                               requests);
+  // 第一块中已有的数据要保留，最后一块超出文件的部分保持为 0
+  UINT32 skip = (UINT32)(offset % block_size);
+  if (requests[0].data == head) {
+    readBlock(disk, requests[0].block_idx, head);
+    memcpy(head + skip, data,
+           size < block_size - skip ? size : block_size - skip);
+  }
+  if (requests[n - 1].data == tail) {
+    size_t start = (size_t)(n - 1) * block_size - skip;
+    memcpy(tail, data + start, size - start);
+  }
+  if (writeBlocks(disk, requests, n) == FAILURE) {
+    ret = FAILURE;
   } else {
-    // 间接索引
-    // 如果没有创建新的 block
-    if (parent_inode->blocks < 7) {
-      Ext2Location block_location = getFreeBlock(disk);
-      parent_inode->block[6] = block_location.block_idx;
-      parent_inode->blocks++;
+    setInodeSize(inode, offset + size);
+    inode->mtime = time(NULL);
+  }
+  free(requests);
+  free(head);
+  return ret;
+}
+
+int readFileRange(Disk* disk,
+                  unsigned int inode_idx,
+                  Ext2Inode* inode,
+                  UINT64 offset,
+                  BYTE* data,
+                  UINT32 size,
+                  UINT32* got) {
+  *got = 0;
+  UINT64 file_size = getInodeSize(inode);
+  if (offset >= file_size) {
+    return SUCCESS;
+  }
+  if (size > file_size - offset) {
+    size = (UINT32)(file_size - offset);
+  }
+  // 还没有落盘的数据直接从延迟写缓冲中复制
+  Ext2Layout* layout = disk->layout;
+  Ext2DelayedWrite* delayed = findDelayedWrite(layout, inode_idx);
+  if (delayed != NULL) {
+    memcpy(data, delayed->data + offset, size);
+    *got = size;
+    return SUCCESS;
+  }
+  UINT32 block_size = layout->block_size;
+  BYTE* head = (BYTE*)malloc(2 * (size_t)block_size);
+  DiskRequest* requests =
+      (DiskRequest*)malloc(((size_t)size / block_size + 2) *
+                           sizeof(DiskRequest));
+  if (head == NULL || requests == NULL) {
+    printf("Out of memory\n");
+    free(requests);
+    free(head);
+    return FAILURE;
+  }
+  BYTE* tail = head + block_size;
+  UINT32 n = fileRangeRequests(disk, inode, offset, size, data, head, tail,
+                               requests);
+  int ret = readBlocks(disk, requests, n);
+  if (ret == SUCCESS) {
+    UINT32 skip = (UINT32)(offset % block_size);
+    if (requests[0].data == head) {
+      memcpy(data, head + skip,
+             size < block_size - skip ? size : block_size - skip);
     }
-    dir_block = dir_block - 6;
-    unsigned int dir_records_per_block = BLOCK_SIZE / sizeof(unsigned int);
-    if (dir_block < dir_records_per_block) {
-      // 一级索引
-      readBlock(disk, parent_inode->block[6], block);
-      if (parent_inode->blocks < dir_block + 6 + 2) {
-        // 为索引块添加一个 block
-        Ext2Location block_location = getFreeBlock(disk);
-        memcpy(block + dir_block * sizeof(int), &block_location.block_idx,
-               sizeof(int));
-        writeBlock(disk, parent_inode->block[6], block);
-        parent_inode->blocks++;
-      }
-      unsigned int block_idx;
-      memcpy(&block_idx, block + dir_block * sizeof(int), sizeof(int));
-      BYTE block1[BLOCK_SIZE];
-      readBlock(disk, block_idx, block1);
-      memcpy(block1 + dir_offset * DIR_SIZE, entry, DIR_SIZE);
-      writeBlock(disk, block_idx, block1);
-      parent_inode->size += DIR_SIZE;
-      return SUCCESS;
-    } else {
-      // 没有初始化二级索引则初始化 block
-      if (parent_inode->blocks < total + 1) {
-        Ext2Location block_location = getFreeBlock(disk);
-        parent_inode->block[7] = block_location.block_idx;
-      }
-      // 二级索引
-      dir_block = dir_block - dir_records_per_block;
-      unsigned block_block = dir_block / dir_records_per_block;
-      unsigned block_offset = dir_block % dir_records_per_block;
-      unsigned int num;
-      // TODO 完成二级索引
-      readBlock(disk, parent_inode->block[7], block);
-      memcpy(&num, block + block_block * sizeof(unsigned int),
-             sizeof(unsigned int));
-      readBlock(disk, DATA_BLOCK_BASE + num, block);
-      memcpy(block + dir_offset * DIR_SIZE, &entry, DIR_SIZE);
-      parent_inode->size += DIR_SIZE;
+    if (requests[n - 1].data == tail) {
+      size_t start = (size_t)(n - 1) * block_size - skip;
+      memcpy(data + start, tail, size - start);
+    }
+    *got = size;
+  }
+  free(requests);
+  free(head);
+  return ret;
+}
+
+// 紧接着 prev 分配一个块，使同一个文件的块尽量连续，失败返回 0
+static UINT32 allocBlockAfter(Disk* disk, unsigned int prev) {
+  unsigned int got;
+  Ext2Location location = allocBlocks(disk, prev == 0 ? 0 : prev + 1, 1, &got);
+  return got == 0 ? 0 : location.block_idx;
+}
+
+int addDirEntry(Disk* disk,
+                Ext2Inode* parent_inode,
+                Ext2DirEntry* entry) {
+  BYTE block[MAX_BLOCK_SIZE];
+  Ext2Layout* layout = disk->layout;
+  unsigned int total = parent_inode->size / DIR_SIZE;
+  unsigned int dir_block = total / layout->dirs_per_block;
+  unsigned int dir_offset = total % layout->dirs_per_block;
+  if (parent_inode->blocks < dir_block + 1) {
+    // 目录块已满时紧接着上一个目录块分配，需要的索引块在映射时分配
+    UINT32 prev =
+        dir_block > 0 ? mapFileBlock(disk, parent_inode, dir_block - 1, NULL)
+                      : 0;
+    UINT32 block_idx = allocBlockAfter(disk, prev);
+    if (block_idx == 0) {
+      printf("No free blocks left\n");
       return FAILURE;
+    }
+    if (appendFileBlocks(disk, parent_inode, dir_block, block_idx, 1) ==
+        FAILURE) {
+      freeBlock(disk, block_idx);
+      printf("No free blocks left\n");
+      return FAILURE;
+    }
+    parent_inode->blocks++;
+  }
+  UINT32 block_idx = mapFileBlock(disk, parent_inode, dir_block, NULL);
+  readBlock(disk, block_idx, block);
+  memcpy(block + dir_offset * DIR_SIZE, entry, DIR_SIZE);
+  writeBlock(disk, block_idx, block);
+  parent_inode->size += DIR_SIZE;
+  if (parent_inode->flags & EXT2_INDEX_FL) {
+    // 索引跟不上目录时整个去掉，目录退回线性查找
+    if (dirIndexInsert(disk, parent_inode, entry->name, total) == FAILURE) {
+      dirIndexDrop(disk, parent_inode);
+    }
+  } else if ((layout->super_block.feature_compat &
+              EXT2_FEATURE_COMPAT_DIR_INDEX) &&
+             total + 1 > layout->dirs_per_block) {
+    // 目录超过一个块后才建立索引，小目录线性查找已经足够快
+    dirIndexBuild(disk, parent_inode);
+  }
+  return SUCCESS;
+}
+
+// 目录自己的 inode 序号记录在它的 "." 目录项中
+static unsigned int dirInodeIndex(Disk* disk, Ext2Inode* dir) {
+  Ext2DirEntry entry;
+  getCurrentEntry(disk, dir, &entry);
+  return entry.inode;
+}
+
+static int lookupDirEntry(Disk* disk,
+                          Ext2Inode* dir,
+                          const char* name,
+                          Ext2DirEntry* entry,
+                          unsigned int* index) {
+  if (dir->flags & EXT2_INDEX_FL) {
+    return dirIndexLookup(disk, dir, name, entry, index);
+  }
+  Ext2DirIter iter;
+  dirIterInit(&iter, disk, dir, 0);
+  while (dirIterNext(&iter, entry, index) == SUCCESS) {
+    if (!strcmp(entry->name, name)) {
       return SUCCESS;
     }
   }
+  return FAILURE;
+}
+
+int findDirEntry(Disk* disk,
+                 unsigned int dir_idx,
+                 Ext2Inode* dir,
+                 const char* name,
+                 Ext2DirEntry* entry,
+                 unsigned int* index) {
+  // "." 和 ".." 总在第一个目录块的开头，不占用缓存
+  DentryCache* dcache = disk->layout->dcache;
+  if (dcache == NULL || !strcmp(name, ".") || !strcmp(name, "..")) {
+    return lookupDirEntry(disk, dir, name, entry, index);
+  }
+  switch (lookupDentry(dcache, dir_idx, name, entry, index)) {
+    case DENTRY_FOUND:
+      return SUCCESS;
+    case DENTRY_NEGATIVE:
+      return FAILURE;
+  }
+  int ret = lookupDirEntry(disk, dir, name, entry, index);
+  addDentry(dcache, dir_idx, name, ret == SUCCESS ? entry : NULL,
+            ret == SUCCESS ? *index : 0);
+  return ret;
 }
 
 int ext2Ls(Ext2FileSystem* file_system, Ext2Inode* current) {
-  unsigned int items = current->size / DIR_SIZE;
-  Ext2DirEntry dir;
   // 读取 current 对应第一块 block
   printf(
       "\x1B[4mType\x1B[0m\t\x1B[4mPermission\x1B[0m\t\t\x1B[4mSize\x1B["
       "0m\t\x1B["
       "4mModify Time\x1B[0m\t\t\t\x1B[4mName\x1B[0m\t\n");
-  BYTE block[BLOCK_SIZE];
-  for (unsigned int i = 0; i < items; i++) {
-    Ext2Location location = getDirEntryLocation(file_system->disk, i, current);
-    readBlock(file_system->disk, location.block_idx, block);
-    memcpy(&dir, block + location.offset, DIR_SIZE);
-    Ext2Inode temp;
-    getInode(file_system->disk, dir.inode, &temp);
-    char str_type[16];
-    char str_permission[64];
-    char str_size[16];
-    char str_time[128];
-    char str_name[16];
-    strcpy(str_name, dir.name);
-    strcpy(str_permission, "");
-    if (dir.file_type == EXT2_DIR) {
-      strcpy(str_type, "Dir");
-      strcat(str_permission, "-\t\t");
-      strcpy(str_size, "-");
-    } else if (dir.file_type == EXT2_FILE) {
-      strcpy(str_type, "File");
-      int permission = temp.mode;
-      if (permission & WRITABLE) {
-        strcat(str_permission, "Writable   ");
-      } else {
-        strcat(str_permission, "Can't Write");
-      }
-      if (permission & READABLE) {
-        strcat(str_permission, "Readable  ");
-      } else {
-        strcat(str_permission, "Can't Read");
+  // 目录项和它们的 inode 分批读出，每批的 inode 表块合并成一次批量读
+  Ext2DirIter iter;
+  dirIterInit(&iter, file_system->disk, current, 0);
+  Ext2DirEntryPlus* batch =
+      (Ext2DirEntryPlus*)malloc(EXT2_READDIR_BATCH * sizeof(Ext2DirEntryPlus));
+  if (batch == NULL) {
+    return FAILURE;
+  }
+  unsigned int got;
+  while (readDirPlus(&iter, batch, EXT2_READDIR_BATCH, &got) == SUCCESS &&
+         got > 0) {
+    for (unsigned int i = 0; i < got; i++) {
+      Ext2DirEntry* dir = &batch[i].entry;
+      Ext2Inode* temp = &batch[i].inode;
+      char str_type[16];
+      char str_permission[64];
+      char str_size[16];
+      char str_time[128];
+      char str_name[16];
+      strcpy(str_name, dir->name);
+      strcpy(str_permission, "");
+      if (dir->file_type == EXT2_DIR) {
+        strcpy(str_type, "Dir");
+        strcat(str_permission, "-\t\t");
+        strcpy(str_size, "-");
+      } else if (dir->file_type == EXT2_FILE) {
+        strcpy(str_type, "File");
+        int permission = temp->mode;
+        if (permission & WRITABLE) {
+          strcat(str_permission, "Writable   ");
+        } else {
+          strcat(str_permission, "Can't Write");
+        }
+        if (permission & READABLE) {
+          strcat(str_permission, "Readable  ");
+        } else {
+          strcat(str_permission, "Can't Read");
+        }
+        sprintf(str_size, "%llu", getInodeSize(temp));
       }
-      sprintf(str_size, "%d", temp.size);
-    }
-    strcpy(str_time, "");
-    strcat(str_time, asctime(localtime(&temp.mtime)));
-    for (int j = 0; j < strlen(str_time); j++) {
-      if (str_time[j] == '\n') {
-        str_time[j] = '\t';
+      strcpy(str_time, "");
+      strcat(str_time, asctime(localtime(&temp->mtime)));
+      for (int j = 0; j < strlen(str_time); j++) {
+        if (str_time[j] == '\n') {
+          str_time[j] = '\t';
+        }
       }
+      printf("%s\t%s\t%s\t%s%s\n", str_type, str_permission, str_size, str_time,
+             str_name);
     }
-    printf("%s\t%s\t%s\t%s%s\n", str_type, str_permission, str_size, str_time,
-           str_name);
   }
+  free(batch);
   return SUCCESS;
 }
 
@@ -591,12 +1471,8 @@ int ext2Tree(Ext2FileSystem* file_system,
   if (depth == 0) {
     printf("/");
   }
-  BYTE block[BLOCK_SIZE];
   Ext2DirEntry current_entry;
-  Ext2Location current_location =
-      getDirEntryLocation(file_system->disk, 1, current_inode);
-  readBlock(file_system->disk, current_location.block_idx, block);
-  memcpy(&current_entry, block + current_location.offset, DIR_SIZE);
+  getCurrentEntry(file_system->disk, current_inode, &current_entry);
   int flag = 0;
   if (current_entry.inode == inode_idx) {
     flag = 1;
@@ -610,15 +1486,11 @@ int ext2Tree(Ext2FileSystem* file_system,
   }
   Ext2Inode current;
   getInode(file_system->disk, inode_idx, &current);
-  unsigned int items = current.size / DIR_SIZE;
   Ext2DirEntry dir;
-  // 读取 current 对应第一块 block
-  for (unsigned int i = 2; i < items; i++) {
-    Ext2Location location = getDirEntryLocation(file_system->disk, i, &current);
-    readBlock(file_system->disk, location.block_idx, block);
-    memcpy(&dir, block + location.offset, DIR_SIZE);
-    Ext2Inode temp;
-    getInode(file_system->disk, dir.inode, &temp);
+  // 跳过 ".." 和 "."
+  Ext2DirIter iter;
+  dirIterInit(&iter, file_system->disk, &current, 2);
+  while (dirIterNext(&iter, &dir, NULL) == SUCCESS) {
     if (dir.file_type == EXT2_DIR) {
       // 目录递归使用 tree
       for (int i = 0; i < depth; i++) {
@@ -636,17 +1508,98 @@ int ext2Tree(Ext2FileSystem* file_system,
   return SUCCESS;
 }
 
-int ext2Mount(Ext2FileSystem* file_system, Ext2Inode* current, char* path) {
+int ext2Mount(Ext2FileSystem* file_system,
+              Ext2Inode* current,
+              char* path,
+              Ext2MountOptions* options) {
   if (file_system->disk == NULL) {
     file_system->disk = (Disk*)malloc(sizeof(Disk));
   }
   // 挂载磁盘
-  loadDisk(file_system->disk, path);
+  int ret;
+  switch (options->backend) {
+    case DISK_BACKEND_MMAP:
+      ret = loadDiskMmap(file_system->disk, path);
+      break;
+    case DISK_BACKEND_URING:
+      ret = loadDiskUring(file_system->disk, path);
+      break;
+    default:
+      ret = loadDisk(file_system->disk, path);
+      break;
+  }
+  if (ret == FAILURE) {
+    return FAILURE;
+  }
+  // 按超级块中记录的几何信息建立布局
+  Ext2SuperBlock super_block;
+  getSuperBlock(file_system->disk, &super_block);
+  if (SECTOR_SIZE << super_block.log_block_size > MAX_BLOCK_SIZE) {
+    printf("Unsupported block size in the super block\n");
+    closeDisk(file_system->disk);
+    return FAILURE;
+  }
+  if (loadLayout(file_system->disk, &super_block) == FAILURE) {
+    freeLayout(file_system->disk);
+    closeDisk(file_system->disk);
+    return FAILURE;
+  }
+  // 挂载期间的块读写都经过缓存
+  if (options->cache_blocks > 0) {
+    file_system->disk->cache =
+        createBlockCache(options->cache_blocks,
+                         file_system->disk->layout->block_size,
+                         options->write_back);
+  }
+  // 根目录和当前目录在挂载期间常驻 inode 缓存
+  file_system->disk->layout->icache = createInodeCache(DEFAULT_INODE_CACHE);
+  if (file_system->disk->layout->icache != NULL) {
+    // 一次作为根目录，一次作为当前目录
+    acquireInode(file_system->disk->layout->icache, file_system->disk, 0);
+    acquireInode(file_system->disk->layout->icache, file_system->disk, 0);
+  }
+  file_system->disk->layout->dcache = createDentryCache(DEFAULT_DENTRY_CACHE);
+  file_system->cwd = 0;
+  strcpy(file_system->cwd_path, "/");
+  forgetPaths(file_system);
   // 得到根路径
   getRootInode(file_system->disk, current);
   return SUCCESS;
 }
 
+int ext2Sync(Ext2FileSystem* file_system) {
+  // 先为延迟写的文件分配块并写入数据，再写入内存中的超级块和组描述符，
+  // 最后随缓存一起落盘。有文件没能完整落盘时其余部分仍照常写入
+  int ret = flushDelayedWrites(file_system->disk);
+  if (file_system->disk->layout->icache != NULL) {
+    flushInodeCache(file_system->disk->layout->icache, file_system->disk);
+  }
+  syncMetadata(file_system->disk);
+  if (file_system->disk->cache != NULL) {
+    if (flushBlockCache(file_system->disk->cache, file_system->disk) ==
+        FAILURE) {
+      ret = FAILURE;
+    }
+  }
+  syncDisk(file_system->disk);
+  return ret;
+}
+
+int ext2Umount(Ext2FileSystem* file_system) {
+  // 先为延迟写的文件分配块，再归还未用完的预分配窗口，多出的空间还可以
+  // 让没能落盘的文件在 sync 中再试一次
+  flushDelayedWrites(file_system->disk);
+  releaseAllPrealloc(file_system->disk);
+  int ret = ext2Sync(file_system);
+  destroyInodeCache(file_system->disk->layout->icache);
+  destroyDentryCache(file_system->disk->layout->dcache);
+  destroyBlockCache(file_system->disk->cache);
+  file_system->disk->cache = NULL;
+  freeLayout(file_system->disk);
+  closeDisk(file_system->disk);
+  return ret;
+}
+
 int ext2Mkdir(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   if (strlen(name) >= DIR_NAME_LEN) {
     printf(
@@ -656,60 +1609,70 @@ int ext2Mkdir(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   }
   // 查询是否已经存在同名文件
   Ext2DirEntry entry;
-  unsigned int items = current->size / DIR_SIZE;
-  for (unsigned int i = 2; i < items; i++) {
-    getDirEntry(file_system->disk, i, current, &entry);
-    if (!strcmp(entry.name, name)) {
-      // 存在同名文件
-      printf("There are already a file or directory named %s\n", name);
-      return FAILURE;
-    }
+  unsigned int entry_index;
+  unsigned int dir_idx = dirInodeIndex(file_system->disk, current);
+  if (findDirEntry(file_system->disk, dir_idx, current, name, &entry,
+                   &entry_index) == SUCCESS) {
+    // 存在同名文件
+    printf("There are already a file or directory named %s\n", name);
+    return FAILURE;
   }
 
   // 没有同名文件或文件夹，新建一个 inode
-  Ext2Location inode_location = getFreeInode(file_system->disk);
   // 空闲 inode 的序号
-  unsigned int inode_idx =
-      (inode_location.block_idx - INODE_TABLE_BASE) * INODES_PER_BLOCK +
-      inode_location.offset / INODE_SIZE;
+  unsigned int inode_idx;
+  Ext2Location inode_location = getFreeInode(file_system->disk, &inode_idx);
+  if (inode_location.block_idx == (UINT32)-1) {
+    printf("Error : no free inode left!\n");
+    return FAILURE;
+  }
 
-  // 将新的目录项添加到父目录下
+  // 新目录的目录项
   strcpy(entry.name, name);
   entry.inode = inode_idx;
   entry.name_len = strlen(name);
   entry.file_type = EXT2_DIR;
   entry.rec_len = 2;
-  addDirEntry(file_system->disk, current, &entry);
-  // 获得当前目录的 Dir Entry
+  // 获得当前目录的 Dir Entry，新目录的 ".." 会使它的链接数加一
   Ext2DirEntry parent_entry;
   getCurrentEntry(file_system->disk, current, &parent_entry);
   parent_entry.rec_len++;
-  writeCurrentEntry(file_system->disk, current, &parent_entry);
 
-  // 写入新目录的 inode
+  // 先建好新目录，再挂到父目录下，任何一步没有空间时只需释放新目录
   Ext2Inode new_inode;
   memset(&new_inode, 0, INODE_SIZE);
   new_inode.mode = EXT2_DIR;
   new_inode.blocks = 0;
   new_inode.size = 0;
-
-  // 写入 dir entry
-  // 写入上级目录
-  strcpy(parent_entry.name, "..");
-  addDirEntry(file_system->disk, &new_inode, &parent_entry);
-
-  // 写入当前目录
-  strcpy(entry.name, ".");
-  addDirEntry(file_system->disk, &new_inode, &entry);
-
+  initInodeMap(file_system->disk, &new_inode);
+
+  // 写入上级目录和当前目录
+  Ext2DirEntry dotdot_entry;
+  Ext2DirEntry dot_entry;
+  memcpy(&dotdot_entry, &parent_entry, sizeof(Ext2DirEntry));
+  memcpy(&dot_entry, &entry, sizeof(Ext2DirEntry));
+  strcpy(dotdot_entry.name, "..");
+  strcpy(dot_entry.name, ".");
+  entry_index = current->size / DIR_SIZE;
+  if (addDirEntry(file_system->disk, &new_inode, &dotdot_entry) == FAILURE ||
+      addDirEntry(file_system->disk, &new_inode, &dot_entry) == FAILURE ||
+      addDirEntry(file_system->disk, current, &entry) == FAILURE) {
+    truncateFileBlocks(file_system->disk, &new_inode, 0);
+    freeInode(file_system->disk, inode_idx);
+    return FAILURE;
+  }
+  if (file_system->disk->layout->dcache != NULL) {
+    // 新文件名覆盖刚才记下的“不存在”
+    addDentry(file_system->disk->layout->dcache, dir_idx, name, &entry,
+              entry_index);
+  }
+  writeCurrentEntry(file_system->disk, current, &parent_entry);
   writeInode(file_system->disk, &new_inode, &inode_location);
 
   // 更新 current
   unsigned int parent_inode_index = parent_entry.inode;
-  Ext2Location parent_location;
-  parent_location.block_idx =
-      INODE_TABLE_BASE + parent_inode_index / INODES_PER_BLOCK;
-  parent_location.offset = (parent_inode_index % INODES_PER_BLOCK) * INODE_SIZE;
+  Ext2Location parent_location =
+      getInodeLocation(file_system->disk, parent_inode_index);
   writeInode(file_system->disk, current, &parent_location);
 
   return SUCCESS;
@@ -724,22 +1687,23 @@ int ext2Touch(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   }
   // 查询是否已经存在同名文件
   Ext2DirEntry entry;
-  unsigned int items = current->size / DIR_SIZE;
-  for (unsigned int i = 2; i < items; i++) {
-    getDirEntry(file_system->disk, i, current, &entry);
-    if (!strcmp(entry.name, name)) {
-      // 存在同名文件
-      printf("There are already a file or directory named %s\n", name);
-      return FAILURE;
-    }
+  unsigned int entry_index;
+  unsigned int dir_idx = dirInodeIndex(file_system->disk, current);
+  if (findDirEntry(file_system->disk, dir_idx, current, name, &entry,
+                   &entry_index) == SUCCESS) {
+    // 存在同名文件
+    printf("There are already a file or directory named %s\n", name);
+    return FAILURE;
   }
 
   // 没有同名文件或文件夹，新建一个 inode
-  Ext2Location inode_location = getFreeInode(file_system->disk);
   // 空闲 inode 的序号
-  unsigned int inode_idx =
-      (inode_location.block_idx - INODE_TABLE_BASE) * INODES_PER_BLOCK +
-      inode_location.offset / INODE_SIZE;
+  unsigned int inode_idx;
+  Ext2Location inode_location = getFreeInode(file_system->disk, &inode_idx);
+  if (inode_location.block_idx == (UINT32)-1) {
+    printf("Error : no free inode left!\n");
+    return FAILURE;
+  }
 
   // 将新的目录项添加到父目录下
   strcpy(entry.name, name);
@@ -747,7 +1711,17 @@ int ext2Touch(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   entry.name_len = strlen(name);
   entry.file_type = EXT2_FILE;
   entry.rec_len = 0;
-  addDirEntry(file_system->disk, current, &entry);
+  entry_index = current->size / DIR_SIZE;
+  if (addDirEntry(file_system->disk, current, &entry) == FAILURE) {
+    // 目录放不下新的目录项，刚取到的 inode 还给位图
+    freeInode(file_system->disk, inode_idx);
+    return FAILURE;
+  }
+  if (file_system->disk->layout->dcache != NULL) {
+    // 新文件名覆盖刚才记下的“不存在”
+    addDentry(file_system->disk->layout->dcache, dir_idx, name, &entry,
+              entry_index);
+  }
   // 获得当前目录的 Dir Entry
   Ext2DirEntry parent_entry;
   getCurrentEntry(file_system->disk, current, &parent_entry);
@@ -760,14 +1734,13 @@ int ext2Touch(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   new_inode.mode = EXT2_FILE | WRITABLE | READABLE;
   new_inode.blocks = 0;
   new_inode.size = 0;
+  initInodeMap(file_system->disk, &new_inode);
   writeInode(file_system->disk, &new_inode, &inode_location);
 
   // 更新 current
   unsigned int parent_inode_index = parent_entry.inode;
-  Ext2Location parent_location;
-  parent_location.block_idx =
-      INODE_TABLE_BASE + parent_inode_index / INODES_PER_BLOCK;
-  parent_location.offset = (parent_inode_index % INODES_PER_BLOCK) * INODE_SIZE;
+  Ext2Location parent_location =
+      getInodeLocation(file_system->disk, parent_inode_index);
   writeInode(file_system->disk, current, &parent_location);
 
   return SUCCESS;
@@ -779,18 +1752,17 @@ int ext2Chmod(Ext2FileSystem* file_system,
               char* name) {
   // 先找到这个文件入口
   Ext2DirEntry entry;
-  unsigned int items = current->size / DIR_SIZE;
-  for (unsigned int i = 2; i < items; i++) {
-    getDirEntry(file_system->disk, i, current, &entry);
-    if (!strcmp(entry.name, name)) {
-      // 找到同名的 Dir Entry
-      if (entry.file_type != EXT2_FILE) {
-        // 不是文件
-        printf("This is a directory!\n");
-        return FAILURE;
-      }
-      break;
-    }
+  unsigned int entry_index;
+  if (findDirEntry(file_system->disk,
+                   dirInodeIndex(file_system->disk, current), current, name,
+                   &entry, &entry_index) == FAILURE) {
+    printf("The file named \"%s\" isn't exist\n", name);
+    return FAILURE;
+  }
+  if (entry.file_type != EXT2_FILE) {
+    // 不是文件
+    printf("This is a directory!\n");
+    return FAILURE;
   }
   Ext2Inode inode;
   getInode(file_system->disk, entry.inode, &inode);
@@ -810,9 +1782,7 @@ int ext2Chmod(Ext2FileSystem* file_system,
       inode.mode |= READABLE;
     }
   }
-  Ext2Location location;
-  location.block_idx = INODE_TABLE_BASE + entry.inode / INODES_PER_BLOCK;
-  location.offset = (entry.inode % INODES_PER_BLOCK) * INODE_SIZE;
+  Ext2Location location = getInodeLocation(file_system->disk, entry.inode);
   writeInode(file_system->disk, &inode, &location);
   return SUCCESS;
 }
@@ -825,6 +1795,58 @@ int ext2Rm(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   return deleteDirEntry(file_system, current, name, EXT2_FILE);
 }
 
+// 判断 inode_idx 是否是当前目录或它的上级目录，沿 ".." 一直找到根目录
+static int isCwdOrAncestor(Ext2FileSystem* file_system,
+                           unsigned int inode_idx) {
+  unsigned int idx = file_system->cwd;
+  // 路径中每一级至少占两个字符，层数不会超过 EXT2_PATH_MAX / 2
+  for (int depth = 0; depth < EXT2_PATH_MAX / 2; depth++) {
+    if (idx == inode_idx) {
+      return 1;
+    }
+    if (idx == 0) {
+      return 0;
+    }
+    Ext2Inode dir;
+    Ext2DirEntry parent;
+    getInode(file_system->disk, idx, &dir);
+    getParentEntry(file_system->disk, &dir, &parent);
+    idx = parent.inode;
+  }
+  return 0;
+}
+
+// 释放已经从上级目录中移除的文件或目录。目录整个被删除，子项不必逐个从
+// 目录中移除，用迭代器遍历一遍后递归释放
+static void destroyInode(Ext2FileSystem* file_system,
+                         unsigned int inode_idx,
+                         int type) {
+  Disk* disk = file_system->disk;
+  Ext2Inode inode;
+  getInode(disk, inode_idx, &inode);
+  if (type == EXT2_DIR) {
+    Ext2DirEntry child;
+    Ext2DirIter iter;
+    dirIterInit(&iter, disk, &inode, 2);
+    while (dirIterNext(&iter, &child, NULL) == SUCCESS) {
+      destroyInode(file_system, child.inode, child.file_type);
+    }
+    if (disk->layout->dcache != NULL) {
+      forgetDirDentries(disk->layout->dcache, inode_idx);
+    }
+    dirIndexDrop(disk, &inode);
+  } else {
+    // 丢弃文件还没有落盘的数据，它们从未占用过块。再释放预分配窗口
+    dropDelayedWrite(disk, inode_idx);
+    if (inode.blocks > 0) {
+      releasePrealloc(disk, mapFileBlock(disk, &inode, inode.blocks - 1, NULL));
+    }
+  }
+  // 释放所有数据块和各级索引块，再删除 inode
+  truncateFileBlocks(disk, &inode, 0);
+  freeInode(disk, inode_idx);
+}
+
 int deleteDirEntry(Ext2FileSystem* file_system,
                    Ext2Inode* current,
                    char* name,
@@ -834,7 +1856,7 @@ int deleteDirEntry(Ext2FileSystem* file_system,
   // inode,并将该 inode 下的所有 block 都释放
   // 2. 如果删除的是文件夹，则在当前文件夹下删除该目录的 dir
   // entry，然后遍历文件夹下的所有文件进行删除，并再次递归删除文件夹下的所有文件夹
-  BYTE block[BLOCK_SIZE];
+  BYTE block[MAX_BLOCK_SIZE];
   // 无法删除上级目录和当前目录
   if (!strcmp(name, ".") || !strcmp(name, "..")) {
     printf("Error : can't delete current work directory!\n");
@@ -842,32 +1864,34 @@ int deleteDirEntry(Ext2FileSystem* file_system,
   }
   // 寻找文件/目录的 Dir Entry
   Ext2DirEntry entry;  // 要删除的 Dir Entry
-  int entry_index;
-  Ext2DirEntry last_entry;  // 当前目录最后的 Dir Entry
-  unsigned int items = current->size / DIR_SIZE;
-  for (unsigned int i = 2; i < items; i++) {
-    getDirEntry(file_system->disk, i, current, &last_entry);
-    if (!strcmp(last_entry.name, name)) {
-      // 找到同名的 Dir Entry
-      if (last_entry.file_type != type) {
-        // 类型不同，删除失败
-        switch (last_entry.file_type) {
-          case EXT2_DIR:
-            printf("This is directory, please use \"rmdir\" to delete!\n");
-            return FAILURE;
-          case EXT2_FILE:
-            printf("This is a file, please use \"rm\" to delete!\n");
-            return FAILURE;
-          default:
-            printf("Error : Invalid file type!\n");
-            return FAILURE;
-        }
-      }
-      // 记录待删除 Dir Entry 的位置
-      memcpy(&entry, &last_entry, DIR_SIZE);
-      entry_index = i;
+  unsigned int entry_index;
+  unsigned int dir_idx = dirInodeIndex(file_system->disk, current);
+  if (findDirEntry(file_system->disk, dir_idx, current, name, &entry,
+                   &entry_index) == FAILURE) {
+    printf("There's no file or directory named \"%s\"\n", name);
+    return FAILURE;
+  }
+  if (entry.file_type != type) {
+    // 类型不同，删除失败
+    switch (entry.file_type) {
+      case EXT2_DIR:
+        printf("This is directory, please use \"rmdir\" to delete!\n");
+        return FAILURE;
+      case EXT2_FILE:
+        printf("This is a file, please use \"rm\" to delete!\n");
+        return FAILURE;
+      default:
+        printf("Error : Invalid file type!\n");
+        return FAILURE;
     }
   }
+  if (type == EXT2_DIR && isCwdOrAncestor(file_system, entry.inode)) {
+    printf("Error : can't delete current work directory!\n");
+    return FAILURE;
+  }
+  Ext2DirEntry last_entry;  // 当前目录最后的 Dir Entry
+  unsigned int items = current->size / DIR_SIZE;
+  getDirEntry(file_system->disk, items - 1, current, &last_entry);
 
   // * 先删除当前目录的信息
   // 将 inode->block 中最后的 entry 与待删除的 entry 互换位置
@@ -880,131 +1904,87 @@ int deleteDirEntry(Ext2FileSystem* file_system,
     memcpy(block + entry_loc.offset, &last_entry, DIR_SIZE);
     writeBlock(file_system->disk, entry_loc.block_idx, block);
   }
+  if ((current->flags & EXT2_INDEX_FL) &&
+      dirIndexRemove(file_system->disk, current, entry.name, entry_index,
+                     last_entry.name, items - 1) == FAILURE) {
+    dirIndexDrop(file_system->disk, current);
+  }
+  DentryCache* dcache = file_system->disk->layout->dcache;
+  if (dcache != NULL) {
+    // 被删除的文件名记为不存在，被移动的目录项换了位置
+    addDentry(dcache, dir_idx, entry.name, NULL, 0);
+    if (entry_index != items - 1) {
+      addDentry(dcache, dir_idx, last_entry.name, &last_entry, entry_index);
+    }
+  }
   Ext2Location last_location;  // 最后 entry 的位置
   last_location = getDirEntryLocation(file_system->disk, items - 1, current);
   if (last_location.offset == 0) {
-    // 在新块
-    freeBlock(file_system->disk, last_location.block_idx);
+    // 最后一个目录块已经空了，连同不再需要的索引块一起释放
+    current->blocks--;
+    truncateFileBlocks(file_system->disk, current, current->blocks);
   }
   current->size -= DIR_SIZE;
   // 将 current 更新到 disk
   Ext2DirEntry current_entry;
   getDirEntry(file_system->disk, 1, current, &current_entry);
   int current_inode_index = current_entry.inode;
-  Ext2Location loc;
-  loc.block_idx = INODE_TABLE_BASE + current_inode_index / INODES_PER_BLOCK;
-  loc.offset = (current_inode_index % INODES_PER_BLOCK) * INODE_SIZE;
+  Ext2Location loc = getInodeLocation(file_system->disk, current_inode_index);
   writeInode(file_system->disk, current, &loc);
 
   // * 再处理待删除的 inode
-  int inode_idx = entry.inode;
-  Ext2Inode inode;
-  getInode(file_system->disk, inode_idx, &inode);
   if (type == EXT2_DIR) {
-    // 如果删除的是文件夹
-    if (inode.size == DIR_SIZE * 2) {
-      // 空文件夹，直接删除
-      freeBlock(file_system->disk, inode.block[0]);
-      freeInode(file_system->disk, inode_idx);
-      return SUCCESS;
-    }
-    // 文件夹非空，遍历删除
-    for (int ii = 2; ii < inode.size / DIR_SIZE; ii++) {
-      Ext2DirEntry child_entry;
-      getDirEntry(file_system->disk, ii, &inode, &child_entry);
-      if (child_entry.file_type == EXT2_DIR) {
-        ext2Rmdir(file_system, &inode, child_entry.name);
-      } else {
-        ext2Rm(file_system, &inode, child_entry.name);
-      }
-      // 删除当前 inode
-      freeInode(file_system->disk, inode_idx);
-      return SUCCESS;
-    }
-  } else {
-    // 如果删除的是文件
-    for (int ii = 2; ii < inode.blocks; ii++) {
-      // 将文件的 block 都删除
-      // 先删除文件的直接索引
-      Ext2Location location =
-          getDirEntryLocation(file_system->disk, ii * 12, &inode);
-      freeBlock(file_system->disk, location.block_idx);
-      setBlockBitmap(file_system->disk, location.block_idx, 0);
-      // TODO 删除所有一级索引
-      // TODO 删除所有二级索引
-      // 删除当前 inode
-      freeInode(file_system->disk, inode_idx);
-      return SUCCESS;
-    }
+    // 缓存的路径可能经过这个目录，它的 inode 之后还会被复用
+    forgetPaths(file_system);
   }
-
-  return FAILURE;
+  destroyInode(file_system, entry.inode, type);
+  return SUCCESS;
 }
 
-int ext2Open(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
-  if (!strcmp(name, "/")) {
-    for (int i = 0; i < 100; i++) {
-      ext2Open(file_system, current, "..");
-    }
-    return 0;
-  }
+int ext2Open(Ext2FileSystem* file_system, Ext2Inode* current, char* path) {
+  // 整条路径一次解析，绝对路径直接从根目录或缓存的前缀开始
   Ext2DirEntry entry;
-  BYTE block[BLOCK_SIZE];
-
-  // 当前目录的文件项数
-  unsigned int items = current->size / DIR_SIZE;
-  for (int i = 0; i < items; i++) {
-    // 得到第 i 个 Dir Entry 的绝对位置
-    Ext2Location dir_location =
-        getDirEntryLocation(file_system->disk, i, current);
-    readBlock(file_system->disk, dir_location.block_idx, block);
-    memcpy(&entry, block + dir_location.offset, DIR_SIZE);
-    if (!strcmp(entry.name, name)) {
-      if (entry.file_type == EXT2_FILE) {
-        printf("It's not a directory!\n");
-        return FAILURE;
-      }
-      Ext2Inode root_inode;
-      readBlock(file_system->disk, INODE_TABLE_BASE, block);
-      memcpy(&root_inode, block, INODE_SIZE);
-      getInode(file_system->disk, entry.inode, current);
-      return SUCCESS;
-    }
+  Ext2Inode inode;
+  char cwd_path[EXT2_PATH_MAX];
+  if (normalizePath(file_system->cwd_path, path, cwd_path) == FAILURE ||
+      resolvePath(file_system, file_system->cwd, path, &entry, &inode) ==
+          FAILURE) {
+    printf("There's no directory named \"%s\"\n", path);
+    return FAILURE;
   }
-  printf("There's no directory named \"%s\"\n", name);
-  return FAILURE;
+  if (entry.file_type == EXT2_FILE) {
+    printf("It's not a directory!\n");
+    return FAILURE;
+  }
+  memcpy(current, &inode, sizeof(Ext2Inode));
+  InodeCache* icache = file_system->disk->layout->icache;
+  if (icache != NULL && entry.inode != file_system->cwd) {
+    // 新的当前目录常驻缓存，旧的当前目录可以被换出
+    acquireInode(icache, file_system->disk, entry.inode);
+    releaseInode(icache, file_system->cwd);
+  }
+  file_system->cwd = entry.inode;
+  strcpy(file_system->cwd_path, cwd_path);
+  return SUCCESS;
 }
 
 int ext2Write(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   // 先找到这个文件入口
   Ext2DirEntry entry;
-  unsigned int items = current->size / DIR_SIZE;
-  for (unsigned int i = 2; i < items; i++) {
-    getDirEntry(file_system->disk, i, current, &entry);
-    if (!strcmp(entry.name, name)) {
-      // 找到同名的 Dir Entry
-      if (entry.file_type != EXT2_FILE) {
-        // 不是文件
-        printf("This is a directory!\n");
-        return FAILURE;
-      }
-      break;
-    }
-  }
-
-  if (strcmp(entry.name, name)) {
-    // 文件不存在
+  unsigned int entry_index;
+  if (findDirEntry(file_system->disk,
+                   dirInodeIndex(file_system->disk, current), current, name,
+                   &entry, &entry_index) == FAILURE) {
+    // 文件不存在，新建后它是目录的最后一项
     if (ext2Touch(file_system, current, name) == FAILURE) {
       return FAILURE;
     }
-    // 找到这个文件入口
-    unsigned int items = current->size / DIR_SIZE;
-    for (unsigned int i = 2; i < items; i++) {
-      getDirEntry(file_system->disk, i, current, &entry);
-      if (!strcmp(entry.name, name)) {
-        break;
-      }
-    }
+    getDirEntry(file_system->disk, current->size / DIR_SIZE - 1, current,
+                &entry);
+  } else if (entry.file_type != EXT2_FILE) {
+    // 不是文件
+    printf("This is a directory!\n");
+    return FAILURE;
   }
 
   // 找到 entry 后
@@ -1016,10 +1996,8 @@ int ext2Write(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
         "write this file.\n");
     return FAILURE;
   }
-  writeFile(file_system->disk, &inode);
-  Ext2Location loc;
-  loc.block_idx = INODE_TABLE_BASE + entry.inode / INODES_PER_BLOCK;
-  loc.offset = (entry.inode % INODES_PER_BLOCK) * INODE_SIZE;
+  writeFile(file_system->disk, entry.inode, &inode);
+  Ext2Location loc = getInodeLocation(file_system->disk, entry.inode);
   writeInode(file_system->disk, &inode, &loc);
 
   return SUCCESS;
@@ -1028,25 +2006,19 @@ int ext2Write(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
 int ext2Cat(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
   // 先找到这个文件入口
   Ext2DirEntry entry;
-  unsigned int items = current->size / DIR_SIZE;
-  for (unsigned int i = 2; i < items; i++) {
-    getDirEntry(file_system->disk, i, current, &entry);
-    if (!strcmp(entry.name, name)) {
-      // 找到同名的 Dir Entry
-      if (entry.file_type != EXT2_FILE) {
-        // 不是文件
-        printf("This is a directory!\n");
-        return FAILURE;
-      }
-      break;
-    }
-  }
-
-  if (strcmp(entry.name, name)) {
+  unsigned int entry_index;
+  if (findDirEntry(file_system->disk,
+                   dirInodeIndex(file_system->disk, current), current, name,
+                   &entry, &entry_index) == FAILURE) {
     // 文件不存在
     printf("The file named \"%s\" isn't exist\n", name);
     return FAILURE;
   }
+  if (entry.file_type != EXT2_FILE) {
+    // 不是文件
+    printf("This is a directory!\n");
+    return FAILURE;
+  }
 
   // 找到 entry 后
   Ext2Inode inode;
@@ -1057,61 +2029,165 @@ int ext2Cat(Ext2FileSystem* file_system, Ext2Inode* current, char* name) {
         "write this file.\n");
     return FAILURE;
   }
-  readFile(file_system->disk, &inode);
+  readFile(file_system->disk, entry.inode, &inode);
   return SUCCESS;
 }
 
-void getInodeBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]) {
-  memset(bitmap, 0, BLOCK_SIZE);
-  readBlock(disk, INODE_BITMAP_BASE, bitmap);
+int ext2Append(Ext2FileSystem* file_system,
+               Ext2Inode* current,
+               char* name,
+               BYTE* data,
+               UINT32 size) {
+  Ext2DirEntry entry;
+  unsigned int entry_index;
+  if (findDirEntry(file_system->disk,
+                   dirInodeIndex(file_system->disk, current), current, name,
+                   &entry, &entry_index) == FAILURE) {
+    // 文件不存在，新建后它是目录的最后一项
+    if (ext2Touch(file_system, current, name) == FAILURE) {
+      return FAILURE;
+    }
+    getDirEntry(file_system->disk, current->size / DIR_SIZE - 1, current,
+                &entry);
+  } else if (entry.file_type != EXT2_FILE) {
+    printf("This is a directory!\n");
+    return FAILURE;
+  }
+
+  Ext2Inode inode;
+  getInode(file_system->disk, entry.inode, &inode);
+  if (!(inode.mode & WRITABLE)) {
+    printf(
+        "Permission denied. You can't write this file. Please use \"chmod\" to "
+        "write this file.\n");
+    return FAILURE;
+  }
+  // 即使空间不足，已经写入的部分也要记录到 inode 中
+  int ret = appendFile(file_system->disk, entry.inode, &inode, data, size);
+  Ext2Location loc = getInodeLocation(file_system->disk, entry.inode);
+  writeInode(file_system->disk, &inode, &loc);
+  return ret;
+}
+
+int ext2ReadAt(Ext2FileSystem* file_system,
+               Ext2Inode* current,
+               char* name,
+               UINT64 offset,
+               BYTE* data,
+               UINT32 size,
+               UINT32* got) {
+  Ext2DirEntry entry;
+  unsigned int entry_index;
+  *got = 0;
+  if (findDirEntry(file_system->disk,
+                   dirInodeIndex(file_system->disk, current), current, name,
+                   &entry, &entry_index) == FAILURE) {
+    printf("The file named \"%s\" isn't exist\n", name);
+    return FAILURE;
+  }
+  if (entry.file_type != EXT2_FILE) {
+    printf("This is a directory!\n");
+    return FAILURE;
+  }
+
+  Ext2Inode inode;
+  getInode(file_system->disk, entry.inode, &inode);
+  if (!(inode.mode & READABLE)) {
+    printf(
+        "Permission denied. You can't read this file. Please use \"chmod\" to "
+        "write this file.\n");
+    return FAILURE;
+  }
+  return readFileRange(file_system->disk, entry.inode, &inode, offset, data,
+                       size, got);
+}
+
+void getInodeBitmap(Disk* disk, unsigned int group, BYTE* bitmap) {
+  memset(bitmap, 0, disk->layout->block_size);
+  readBlock(disk, disk->layout->gdt.table[group].inode_bitmap, bitmap);
 }
 
-void getBlockBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]) {
-  memset(bitmap, 0, BLOCK_SIZE);
-  readBlock(disk, BLOCK_BITMAP_BASE, bitmap);
+void getBlockBitmap(Disk* disk, unsigned int group, BYTE* bitmap) {
+  memset(bitmap, 0, disk->layout->block_size);
+  readBlock(disk, disk->layout->gdt.table[group].block_bitmap, bitmap);
 }
 
 void setInodeBitmap(Disk* disk, unsigned int index, int value) {
-  BYTE bitmap[BLOCK_SIZE];
-  getInodeBitmap(disk, bitmap);
-  setBit(bitmap, index, value);
-  writeInodeBitmap(disk, bitmap);
+  BYTE bitmap[MAX_BLOCK_SIZE];
+  unsigned int group = index / disk->layout->inodes_per_group;
+  getInodeBitmap(disk, group, bitmap);
+  setBit(bitmap, index % disk->layout->inodes_per_group, value);
+  writeInodeBitmap(disk, group, bitmap);
 }
 
 void setBlockBitmap(Disk* disk, unsigned int index, int value) {
-  BYTE bitmap[BLOCK_SIZE];
-  getBlockBitmap(disk, bitmap);
-  setBit(bitmap, index, value);
-  writeBlockBitmap(disk, bitmap);
+  BYTE bitmap[MAX_BLOCK_SIZE];
+  unsigned int group = index / disk->layout->blocks_per_group;
+  getBlockBitmap(disk, group, bitmap);
+  setBit(bitmap, index % disk->layout->blocks_per_group, value);
+  writeBlockBitmap(disk, group, bitmap);
 }
 
-void writeInodeBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]) {
-  writeBlock(disk, INODE_BITMAP_BASE, bitmap);
+void writeInodeBitmap(Disk* disk, unsigned int group, BYTE* bitmap) {
+  writeBlock(disk, disk->layout->gdt.table[group].inode_bitmap, bitmap);
 }
 
-void writeBlockBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]) {
-  writeBlock(disk, BLOCK_BITMAP_BASE, bitmap);
+void writeBlockBitmap(Disk* disk, unsigned int group, BYTE* bitmap) {
+  writeBlock(disk, disk->layout->gdt.table[group].block_bitmap, bitmap);
 }
 
 int printDiskInfo(Disk* disk) {
-  Ext2SuperBlock super_block;
-  getSuperBlock(disk, &super_block);
+  // 挂载期间内存中的超级块和组描述符才是最新的
+  Ext2Layout* layout = disk->layout;
+  Ext2SuperBlock* super_block = &layout->super_block;
   printf("Disk Info:\n");
   printf("    Inode size: %d bytes\n", INODE_SIZE);
-  printf("    Block size: %d bytes\n", BLOCK_SIZE);
-  printf("    Inodes count: %d\n", super_block.inodes_count);
-  printf("    Blocks count: %d\n", super_block.blocks_count);
-  printf("    Free Inodes: %d\n", super_block.free_inodes_count);
-  printf("    Free Blocks: %d\n", super_block.free_blocks_count);
+  printf("    Block size: %d bytes\n", layout->block_size);
+  printf("    Inodes count: %d\n", super_block->inodes_count);
+  printf("    Blocks count: %d\n", super_block->blocks_count);
+  printf("    Free Inodes: %d\n", super_block->free_inodes_count);
+  printf("    Free Blocks: %d\n", super_block->free_blocks_count);
+  unsigned int prealloc_blocks = 0;
+  for (int i = 0; i < EXT2_PREALLOC_SLOTS; i++) {
+    prealloc_blocks += layout->prealloc[i].count;
+  }
+  unsigned int delayed_files = 0;
+  for (int i = 0; i < EXT2_DELAYED_SLOTS; i++) {
+    delayed_files += layout->delayed[i].data != NULL;
+  }
+  if (super_block->feature_incompat != 0 || super_block->feature_compat != 0) {
+    printf("    Features:");
+    printFeatures(super_block);
+  }
+  printf("    Prealloc Blocks: %u\n", prealloc_blocks);
+  printf("    Delayed Files: %u\n", delayed_files);
+  printf("    Map Cache: %llu hits, %llu misses, %llu run hits\n",
+         layout->map_hits, layout->map_misses, layout->run_hits);
+  printf("    Groups count: %d\n", layout->groups_count);
+  for (UINT32 group = 0; group < layout->groups_count; group++) {
+    printf("    Group %2u: %u free blocks, %u free inodes, %u dirs\n", group,
+           layout->gdt.table[group].free_blocks_count,
+           layout->gdt.table[group].free_inodes_count,
+           layout->gdt.table[group].used_dirs_count);
+  }
+  if (layout->icache != NULL) {
+    printInodeCacheInfo(layout->icache);
+  }
+  if (layout->dcache != NULL) {
+    printDentryCacheInfo(layout->dcache);
+  }
+  if (disk->cache != NULL) {
+    printCacheInfo(disk->cache);
+  }
   return SUCCESS;
 }
 
-int setBit(BYTE bitmap[BLOCK_SIZE], int index, int value) {
+int setBit(BYTE* bitmap, int index, int value) {
   int byte = index / 8;
   int offset = index % 8;
 
   if (value == 0)
-    bitmap[byte] ^= (0x1 << (7 - offset));
+    bitmap[byte] &= ~(0x1 << (7 - offset));
   else
     bitmap[byte] |= (0x1 << (7 - offset));
   return SUCCESS;
@@ -1131,15 +2207,35 @@ int getOffset(BYTE byte) {
 }
 
 int writeBlock(Disk* disk, unsigned int block_idx, void* block) {
+  if (disk->cache != NULL) {
+    return cacheWriteBlock(disk->cache, disk, block_idx, block);
+  }
   disk->write_disk(disk, block_idx, block);
   return SUCCESS;
 }
 
 int readBlock(Disk* disk, unsigned int block_idx, void* block) {
+  if (disk->cache != NULL) {
+    return cacheReadBlock(disk->cache, disk, block_idx, block);
+  }
   disk->read_disk(disk, block_idx, block);
   return SUCCESS;
 }
 
+int writeBlocks(Disk* disk, DiskRequest* requests, unsigned int count) {
+  if (disk->cache != NULL) {
+    return cacheWriteBlocks(disk->cache, disk, requests, count);
+  }
+  return disk->write_disk_v(disk, requests, count);
+}
+
+int readBlocks(Disk* disk, DiskRequest* requests, unsigned int count) {
+  if (disk->cache != NULL) {
+    return cacheReadBlocks(disk->cache, disk, requests, count);
+  }
+  return disk->read_disk_v(disk, requests, count);
+}
+
 char getCh() {
   char ch;
   struct termios old_t, new_t;
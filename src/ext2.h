@@ -7,8 +7,11 @@
 #include <time.h>
 
 #include "string.h"
+#include "bitmap.h"
+#include "cache.h"
 #include "common.h"
 #include "disk.h"
+#include "uring.h"
 
 /**
  * @brief 超级块占用一个 block，512 bytes
@@ -43,7 +46,11 @@ typedef struct Ext2SuperBlock {
   UINT32 first_ino;      // 第一个非保留的索引结点号
   UINT16 inode_size;     // 索引结点结构的大小
   UINT16 block_group;    // 本 SuperBlock 所在的块组号
-  UINT32 reserved[105];  // 保留
+  UINT32 alloc_group;    // 上次分配块所在的组，下次从这个组开始查找
+  UINT32 old_cursor[16];    // 原来的各组分配游标，已移到组描述符
+  UINT32 feature_incompat;  // 不兼容特性，EXT2_FEATURE_INCOMPAT_*
+  UINT32 feature_compat;    // 兼容特性，EXT2_FEATURE_COMPAT_*
+  UINT32 reserved[86];      // 保留
 } Ext2SuperBlock;
 
 /*
@@ -57,14 +64,17 @@ typedef struct Ext2GroupDesc {
   UINT16 free_inodes_count;  // 本组空闲索引结点的个数
   UINT16 used_dirs_count;    // 本组分配给目录的结点数
   UINT16 pad;                // 填充
-  UINT32 reserved[3];        // 保留
+  UINT32 alloc_cursor;       // 本组下次开始查找空闲块的位置
+  UINT32 reserved[2];        // 保留
 } Ext2GroupDesc;
 
 /*
- * gdt，占用一个 block，最多有16个组
+ * gdt，从 GDT_BLOCK_BASE 开始占用 blocks 个连续的块，块数随组数增长
  */
 typedef struct Ext2GroupDescTable {
-  Ext2GroupDesc table[16];
+  UINT32 groups_count;   // 组数
+  UINT32 blocks;         // 占用的块数
+  Ext2GroupDesc* table;  // 各组的描述符，按整块分配，由 freeGdt 释放
 } Ext2GroupDescTable;
 
 /**
@@ -86,16 +96,14 @@ typedef struct Ext2Inode {
   UINT32 block[EXT2_N_BLOCKS];  // 指向数据块的指针数组
   UINT32 generation;            // 文件的版本号(用于 NFS)
   UINT32 file_acl;              // 文件访问控制表( ACL 已不再使用)
-  UINT32 dir_acl;               // 目录访问控制表( ACL 已不再使用)
+  UINT32 size_high;             // 文件大小的高 32 位(原 dir_acl)
   BYTE frag;                    // 每块中的片数
   BYTE fsize;                   // 片的大小
-  UINT16 reserved[16];          // 保留
+  UINT16 pad;                   // 填充
+  UINT32 tind_block;            // 三级索引块，取自保留区，其余字段位置不变
+  UINT16 reserved[13];          // 保留
 } Ext2Inode;
 
-typedef struct Ext2InodeTable {
-  Ext2Inode table[NUMBER_OF_INODES];
-} Ext2InodeTable;
-
 /**
  * @brief 目录块，占用大小 32 bytes
  *
@@ -118,31 +126,190 @@ typedef struct Ext2Location {
   UINT32 offset;  // 单位 (byte)
 } Ext2Location;
 
+/**
+ * @brief 按块遍历目录项的迭代器。每次批量读入若干个目录块，块内的目录项
+ * 依次取出，每个目录块只映射和读取一次。遍历期间不能修改目录
+ *
+ */
+typedef struct Ext2DirIter {
+  Disk* disk;
+  Ext2Inode* dir;
+  unsigned int items;  // 目录项总数
+  unsigned int next;   // 下一个要取出的目录项序号
+  unsigned int first;  // 缓冲区中第一个目录项的序号
+  unsigned int count;  // 缓冲区中的目录项数
+  BYTE blocks[EXT2_DIR_ITER_BLOCKS * MAX_BLOCK_SIZE];
+} Ext2DirIter;
+
+/**
+ * @brief 预分配窗口，紧跟在某个文件最后一块之后的一段连续块。窗口中的块在
+ * 位图中已经标记为占用，文件再增长时先从窗口中取
+ *
+ */
+typedef struct Ext2Prealloc {
+  UINT32 start;  // 窗口中下一个可用的块，即所属文件最后一块的下一块
+  UINT32 count;  // 窗口中剩余的块数，0 表示空闲
+} Ext2Prealloc;
+
+/**
+ * @brief 映射缓存中的一个索引块。每个索引块只属于一个文件，缓存住从根到
+ * 当前位置的索引块后，顺序访问同一个文件不需要再读索引块
+ *
+ */
+typedef struct Ext2MapSlot {
+  UINT32 block_idx;  // 索引块的块号，0 表示空闲
+  UINT32 last_use;   // 最近一次使用的时刻，用于 LRU 替换
+  int dirty;         // 是否有尚未写回的修改
+  UINT32 addrs[MAX_BLOCK_SIZE / sizeof(UINT32)];  // 索引块的内容
+} Ext2MapSlot;
+
+/**
+ * @brief 一个文件最近解析出的一段连续映射，逻辑块 [logical, logical + len)
+ * 对应物理块 [physical, physical + len)。文件用它的一级索引块号标识，
+ * 文件有索引块时一级索引块总是存在，且只属于这一个文件
+ *
+ */
+typedef struct Ext2MapRun {
+  UINT32 owner;     // 文件的一级索引块号，0 表示空闲
+  UINT32 logical;   // 第一个逻辑块号
+  UINT32 physical;  // 对应的物理块号
+  UINT32 len;       // 连续的块数
+} Ext2MapRun;
+
+/**
+ * @brief 延迟写缓冲，文件内容先留在内存中，落盘时才分配块
+ *
+ */
+typedef struct Ext2DelayedWrite {
+  UINT32 inode_idx;  // 所属文件的 inode 序号
+  UINT32 size;       // 文件内容的字节数
+  BYTE* data;        // 文件内容，NULL 表示空闲
+} Ext2DelayedWrite;
+
+/**
+ * @brief 根据超级块计算出的文件系统布局，format 和 mount 时建立
+ *
+ */
+typedef struct Ext2Layout {
+  UINT32 block_size;           // 块大小
+  UINT32 blocks_count;         // 块总数
+  UINT32 inodes_count;         // inode 总数
+  UINT32 groups_count;         // 块组数
+  UINT32 blocks_per_group;     // 每个组的块数
+  UINT32 inodes_per_group;     // 每个组的 inode 数
+  UINT32 inodes_per_block;     // 每个块中的 inode 数
+  UINT32 dirs_per_block;       // 每个块中的目录项数
+  UINT32 addrs_per_block;      // 每个索引块中的块号数
+  UINT32 inode_table_blocks;   // 每个组的 inode 表占用的块数
+  Ext2SuperBlock super_block;  // 挂载期间的超级块，计数只在内存中修改
+  Ext2GroupDescTable gdt;      // 挂载期间的组描述符表
+  int meta_dirty;              // 超级块或组描述符表是否有未写回的修改
+  Ext2Prealloc prealloc[EXT2_PREALLOC_SLOTS];  // 各文件的预分配窗口
+  unsigned int prealloc_victim;  // 窗口用完时下一个被替换的窗口
+  Ext2DelayedWrite delayed[EXT2_DELAYED_SLOTS];  // 尚未落盘的文件
+  unsigned int delayed_victim;  // 缓冲用完时下一个被落盘的文件
+  struct InodeCache* icache;    // inode 缓存，为 NULL 时直接读写 inode 表
+  struct DentryCache* dcache;   // 目录项缓存，为 NULL 时每次都查找目录
+  Ext2MapSlot map_cache[EXT2_MAP_CACHE_SLOTS];  // 最近用到的索引块
+  UINT32 map_clock;             // 映射缓存的访问计数
+  UINT64 map_hits;              // 映射缓存命中的次数
+  UINT64 map_misses;            // 需要读索引块的次数
+  Ext2MapRun map_runs[EXT2_MAP_RUN_SLOTS];  // 各文件已解析的映射
+  UINT64 run_hits;              // 直接由已解析的映射得到结果的次数
+} Ext2Layout;
+
+/**
+ * @brief 路径前缀缓存中的一个目录，记住规范化的绝对路径解析到的 inode
+ *
+ */
+typedef struct Ext2PathSlot {
+  char path[EXT2_PATH_MAX];  // 规范化的绝对路径，空串表示空闲
+  unsigned int inode_idx;    // 目录的 inode 序号
+  UINT32 last_use;           // 最近一次使用的时刻，用于 LRU 替换
+} Ext2PathSlot;
+
 /**
  * @brief 文件系统
  *
  */
 typedef struct Ext2FileSystem {
   Disk* disk;
+  unsigned int cwd;  // 当前目录的 inode 序号，挂载期间常驻 inode 缓存
+  char cwd_path[EXT2_PATH_MAX];  // 当前目录规范化的绝对路径
+  Ext2PathSlot path_cache[EXT2_PATH_CACHE_SLOTS];  // 最近解析过的目录
+  UINT32 path_clock;             // 路径前缀缓存的访问计数
 } Ext2FileSystem;
 
+/**
+ * @brief 挂载选项
+ *
+ */
+typedef struct Ext2MountOptions {
+  unsigned int cache_blocks;  // 块缓存大小，0 表示不使用缓存
+  int write_back;             // 缓存是否使用写回模式
+  int backend;                // 磁盘读写后端，DISK_BACKEND_*
+} Ext2MountOptions;
+
 
 int checkExt2(char* path);
 
 // initialize -----------
 
-int initSuperBlock(Ext2SuperBlock* super_block);
+int initSuperBlock(Ext2SuperBlock* super_block, UINT32 block_size,
+                   UINT32 blocks_count, UINT32 inodes_per_group);
+/**
+ * @brief 根据超级块建立 disk 的文件系统布局，并设置 disk 的块大小
+ *
+ * @param disk
+ * @param super_block
+ * @return int
+ */
+int loadLayout(Disk* disk, Ext2SuperBlock* super_block);
+
+/**
+ * @brief 释放布局和其中的组描述符表
+ *
+ * @param disk
+ */
+void freeLayout(Disk* disk);
+
+/**
+ * @brief 按超级块中的块数和块大小建立组描述符表，表的内存由 freeGdt 释放
+ *
+ * @param gdt
+ * @param super_block
+ * @return int
+ */
 int initGdt(Ext2GroupDescTable* gdt, Ext2SuperBlock* super_block);
+void freeGdt(Ext2GroupDescTable* gdt);
 int initInodeBitmap(Disk* disk);
 int initBlockBitmap(Disk* disk);
 
+// 新建 inode 时按文件系统的特性初始化块映射，启用 extent 时建立空的 extent 树
+void initInodeMap(Disk* disk, Ext2Inode* inode);
 int initRootDir(Disk* disk);
 
 int writeSuperBlock(Disk* disk, Ext2SuperBlock* super_block);
 int writeGdt(Disk* disk, Ext2GroupDescTable* gdt);
 
 int getSuperBlock(Disk* disk, Ext2SuperBlock* super_block);
-int getGdt(Disk* disk, Ext2GroupDescTable* gdt);
+/**
+ * @brief 读入 groups_count 个组的组描述符表，组数由调用者按超级块算出
+ *
+ * @param disk 块大小已经按超级块设置
+ * @param gdt
+ * @param groups_count
+ * @return int
+ */
+int getGdt(Disk* disk, Ext2GroupDescTable* gdt, UINT32 groups_count);
+
+/**
+ * @brief 将内存中修改过的超级块和组描述符表写回磁盘，在 sync 和 umount 时调用
+ *
+ * @param disk
+ * @return int
+ */
+int syncMetadata(Disk* disk);
 
 void getRootInode(Disk* disk, Ext2Inode* inode);
 
@@ -154,6 +321,15 @@ void getRootInode(Disk* disk, Ext2Inode* inode);
  */
 unsigned int getInodeIndex(Disk* disk, Ext2Inode* inode);
 
+/**
+ * @brief 得到第 index 个 inode 在 inode 表中的绝对位置
+ *
+ * @param disk
+ * @param index
+ * @return Ext2Location
+ */
+Ext2Location getInodeLocation(Disk* disk, unsigned int index);
+
 /**
  * @brief 在 disk 中添加一个 inode
  *
@@ -166,35 +342,156 @@ int writeInode(Disk*, Ext2Inode* inode, Ext2Location* location);
 
 int getInode(Disk* disk, unsigned int index, Ext2Inode* inode);
 
+/**
+ * @brief 得到 inode 记录的 64 位文件大小
+ *
+ * @param inode
+ * @return UINT64
+ */
+UINT64 getInodeSize(Ext2Inode* inode);
+
+/**
+ * @brief 设置 inode 的 64 位文件大小，高 32 位存放在 size_high 中
+ *
+ * @param inode
+ * @param size
+ */
+void setInodeSize(Ext2Inode* inode, UINT64 size);
+
 /**
  * @brief 给 inode 添加一个目录块信息
  *
  * @param disk
  * @param inode
  * @param entry
- * @return unsigned int
+ * @return int 目录需要新块而没有空闲块时返回 FAILURE
+ */
+int addDirEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry);
+
+/**
+ * @brief 在目录中查找名为 name 的目录项。先查目录项缓存，未命中时带有哈希
+ * 索引的目录通过索引查找，否则逐项比较，结果 (包括不存在) 记入缓存
+ *
+ * @param disk
+ * @param dir_idx 目录的 inode 序号，作为缓存的键
+ * @param dir
+ * @param name
+ * @param entry 返回找到的目录项
+ * @param index 返回目录项的序号
+ * @return int 不存在时返回 FAILURE
  */
-unsigned int addDirEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry);
+int findDirEntry(Disk* disk, unsigned int dir_idx, Ext2Inode* dir,
+                 const char* name, Ext2DirEntry* entry, unsigned int* index);
 
 /**
  * @brief 从磁盘中寻找空闲的 inode，并将其设为占用
  *
  * @param disk
+ * @param inode_idx 不为 NULL 时返回 inode 的序号
  * @return Ext2Location 空闲 inode 的绝对位置信息
  */
-Ext2Location getFreeInode(Disk* disk);
+Ext2Location getFreeInode(Disk* disk, unsigned int* inode_idx);
 
 /**
- * @brief 从磁盘中寻找空闲块，并将其设为占用
+ * @brief 从磁盘中寻找一个空闲块，并将其设为占用，相当于不指定目标的
+ * allocBlocks
  *
  * @param disk
  * @return Ext2Location 块的绝对位置信息
  */
 Ext2Location getFreeBlock(Disk* disk);
 
+/**
+ * @brief 在目标块附近分配一段连续的空闲块，位图和计数每次调用只更新一次
+ *
+ * 从 goal 所在的组和位置开始查找，找不到 count 个连续块时返回能找到的最长
+ * 一段。goal 为 0 时从上次分配结束的位置继续
+ *
+ * @param disk
+ * @param goal 目标块号，通常是前一个数据块的下一块
+ * @param count 需要的块数
+ * @param got 返回实际分配的块数
+ * @return Ext2Location 第一块的绝对位置信息，失败时 block_idx 为 -1
+ */
+Ext2Location allocBlocks(Disk* disk, unsigned int goal, unsigned int count,
+                         unsigned int* got);
+
 int freeBlock(Disk* disk, int index);
+
+/**
+ * @brief 释放从 start 开始的 count 个连续块，每个组的位图只读写一次
+ *
+ * @param disk
+ * @param start
+ * @param count
+ * @return int
+ */
+int freeBlocks(Disk* disk, unsigned int start, unsigned int count);
+
+/**
+ * @brief 为文件在最后一块 prev 之后分配最多 count 个连续块
+ *
+ * 优先使用紧跟在 prev 之后的预分配窗口；没有窗口时多分配
+ * EXT2_PREALLOC_BLOCKS 块，多出的部分作为该文件新的窗口
+ *
+ * @param disk
+ * @param prev 文件当前的最后一块，文件为空时为 0
+ * @param count 需要的块数
+ * @param got 返回实际分配的块数
+ * @return Ext2Location 第一块的绝对位置信息
+ */
+Ext2Location allocFileBlocks(Disk* disk, unsigned int prev, unsigned int count,
+                             unsigned int* got);
+
+/**
+ * @brief 归还紧跟在 prev 之后的预分配窗口，文件变短或被删除时调用
+ *
+ * @param disk
+ * @param prev 文件的最后一块
+ */
+void releasePrealloc(Disk* disk, unsigned int prev);
+
+// 归还所有预分配窗口，卸载时调用
+void releaseAllPrealloc(Disk* disk);
 int freeInode(Disk* disk, int index);
 
+/**
+ * @brief 把文件的第 logical 个逻辑块映射到物理块，按 inode 的 flags 使用
+ * extent 树或 block 数组
+ *
+ * @param disk
+ * @param inode
+ * @param logical
+ * @param run 不为 NULL 时返回从该块起物理上连续、可以不再查找的块数
+ * @return UINT32 物理块号
+ */
+UINT32 mapFileBlock(Disk* disk, Ext2Inode* inode, UINT32 logical,
+                    UINT32* run);
+
+/**
+ * @brief 把逻辑块 [logical, logical + count) 映射到物理块 [start, ...)，
+ * 按需分配 extent 树节点或各级索引块
+ *
+ * @param disk
+ * @param inode
+ * @param logical
+ * @param start
+ * @param count
+ * @return int
+ */
+int appendFileBlocks(Disk* disk, Ext2Inode* inode, UINT32 logical,
+                     UINT32 start, UINT32 count);
+
+/**
+ * @brief 只保留文件的前 blocks 个逻辑块，释放其余的数据块和映射用的块
+ *
+ * @param disk
+ * @param inode
+ * @param blocks
+ * @return int
+ */
+int truncateFileBlocks(Disk* disk, Ext2Inode* inode, UINT32 blocks);
+
 /**
  * @brief 从 block 数组中找到第 index 处的块
  *
@@ -210,20 +507,97 @@ int getDirEntry(Disk* disk, unsigned int index, Ext2Inode* parent,
 int writeDirEntry(Disk* disk, unsigned int index, Ext2Inode* parent,
                   Ext2DirEntry* entry);
 
+/**
+ * @brief 从第 start 个目录项开始遍历目录 dir
+ *
+ * @param iter
+ * @param disk
+ * @param dir 遍历结束前必须保持有效且不被修改
+ * @param start 0 从 ".." 开始，2 跳过 ".." 和 "."
+ */
+void dirIterInit(Ext2DirIter* iter, Disk* disk, Ext2Inode* dir,
+                 unsigned int start);
+
+/**
+ * @brief 取出下一个目录项，当前缓冲的目录块用完时再批量读入后面的块
+ *
+ * @param iter
+ * @param entry
+ * @param index 返回目录项的序号，可以为 NULL
+ * @return int 目录项已经遍历完时返回 FAILURE
+ */
+int dirIterNext(Ext2DirIter* iter, Ext2DirEntry* entry, unsigned int* index);
+
 int getCurrentEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry);
 int getParentEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry);
 int writeCurrentEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry);
 int writeParentEntry(Disk* disk, Ext2Inode* inode, Ext2DirEntry* entry);
 
-int writeFile(Disk* disk, Ext2Inode* inode);
-int readFile(Disk* disk, Ext2Inode* inode);
+/**
+ * @brief 从终端读入文件内容。内容只保存在延迟写缓冲中，等 sync、卸载或缓冲
+ * 用完时再一次性分配块，这样文件可以整体连续存放
+ *
+ * @param disk
+ * @param inode_idx 文件的 inode 序号
+ * @param inode 文件的 inode，只更新大小和修改时间
+ * @return int
+ */
+int writeFile(Disk* disk, unsigned int inode_idx, Ext2Inode* inode);
+int readFile(Disk* disk, unsigned int inode_idx, Ext2Inode* inode);
+/**
+ * @brief 把 data 追加到文件末尾，直接分配块并写入，不经过延迟写缓冲。文件
+ * 可以这样分多次写到超过内存能容纳的大小
+ *
+ * @param disk
+ * @param inode_idx 文件的 inode 序号
+ * @param inode 文件的 inode，更新块映射、大小和修改时间，由调用者写回
+ * @param data
+ * @param size 追加的字节数
+ * @return int 空间不足时写入已分配到的部分并返回 FAILURE
+ */
+int appendFile(Disk* disk, unsigned int inode_idx, Ext2Inode* inode,
+               BYTE* data, UINT32 size);
+/**
+ * @brief 读出文件中从 offset 开始的 size 个字节，只读涉及到的块
+ *
+ * @param disk
+ * @param inode_idx 文件的 inode 序号
+ * @param inode 文件的 inode
+ * @param offset 文件中的字节偏移
+ * @param data 至少 size 字节
+ * @param size
+ * @param got 返回实际读出的字节数，读到文件末尾时小于 size
+ * @return int
+ */
+int readFileRange(Disk* disk, unsigned int inode_idx, Ext2Inode* inode,
+                  UINT64 offset, BYTE* data, UINT32 size, UINT32* got);
+
+// 为所有延迟写的文件分配块并写入数据。有文件空间不足或写入失败时返回
+// FAILURE，它的缓冲保留到下次 sync
+int flushDelayedWrites(Disk* disk);
+// 丢弃文件尚未落盘的数据，删除文件时调用
+void dropDelayedWrite(Disk* disk, unsigned int inode_idx);
 
 // shell 调用的操作
 
-int ext2Format(Disk* disk);
+/**
+ * @brief 格式化 disk
+ *
+ * @param disk
+ * @param block_size
+ * @param inode_ratio
+ * @param features 启用的不兼容特性，EXT2_FEATURE_INCOMPAT_*
+ * @param compat_features 启用的兼容特性，EXT2_FEATURE_COMPAT_*
+ * @return int
+ */
+int ext2Format(Disk* disk, unsigned int block_size, unsigned int inode_ratio,
+               UINT32 features, UINT32 compat_features);
 int ext2Ls(Ext2FileSystem* file_system, Ext2Inode* current);
 int ext2Tree(Ext2FileSystem* file_system, int inode_idx, int depth, Ext2Inode*current_inode);
-int ext2Mount(Ext2FileSystem* file_system, Ext2Inode* current, char* path);
+int ext2Mount(Ext2FileSystem* file_system, Ext2Inode* current, char* path,
+              Ext2MountOptions* options);
+int ext2Sync(Ext2FileSystem* file_system);
+int ext2Umount(Ext2FileSystem* file_system);
 int ext2Mkdir(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
 int ext2Touch(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
 int ext2Chmod(Ext2FileSystem* file_system,Ext2Inode*current, int mode, char*name);
@@ -231,30 +605,67 @@ int ext2Rmdir(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
 int ext2Rm(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
 int deleteDirEntry(Ext2FileSystem* file_system, Ext2Inode* current, char* name,
                    int type);
-int ext2Open(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
+/**
+ * @brief 进入 path 所指的目录，path 可以是多级的绝对路径或相对路径
+ *
+ * @param file_system
+ * @param current 返回新的当前目录的 inode
+ * @param path
+ * @return int
+ */
+int ext2Open(Ext2FileSystem* file_system, Ext2Inode* current, char* path);
 int ext2Write(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
 int ext2Cat(Ext2FileSystem* file_system, Ext2Inode* current, char* name);
+/**
+ * @brief 把 data 追加到当前目录下的文件 name 末尾，文件不存在时新建
+ *
+ * @param file_system
+ * @param current 当前目录的 inode
+ * @param name
+ * @param data
+ * @param size 追加的字节数
+ * @return int
+ */
+int ext2Append(Ext2FileSystem* file_system, Ext2Inode* current, char* name,
+               BYTE* data, UINT32 size);
+/**
+ * @brief 读出当前目录下的文件 name 中从 offset 开始的 size 个字节
+ *
+ * @param file_system
+ * @param current 当前目录的 inode
+ * @param name
+ * @param offset 文件中的字节偏移
+ * @param data 至少 size 字节
+ * @param size
+ * @param got 返回实际读出的字节数，读到文件末尾时小于 size
+ * @return int
+ */
+int ext2ReadAt(Ext2FileSystem* file_system, Ext2Inode* current, char* name,
+               UINT64 offset, BYTE* data, UINT32 size, UINT32* got);
 
 // Bitmap 操作
 
-void getInodeBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]);
-void getBlockBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]);
+// 每个组有自己的位图，group 为组号，index 为全局的块号或 inode 序号
+void getInodeBitmap(Disk* disk, unsigned int group, BYTE* bitmap);
+void getBlockBitmap(Disk* disk, unsigned int group, BYTE* bitmap);
 void setBlockBitmap(Disk* disk, unsigned int index, int value);
 void setInodeBitmap(Disk* disk, unsigned int index, int value);
-void writeInodeBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]);
-void writeBlockBitmap(Disk* disk, BYTE bitmap[BLOCK_SIZE]);
+void writeInodeBitmap(Disk* disk, unsigned int group, BYTE* bitmap);
+void writeBlockBitmap(Disk* disk, unsigned int group, BYTE* bitmap);
 
 int printDiskInfo(Disk*disk);
 
 // 位操作
 
 // 将位图 block 位于 index 处的值设为 value
-int setBit(BYTE bitmap[BLOCK_SIZE], int index, int value);
-// 得到从左往右第一个 0 的位置
+int setBit(BYTE* bitmap, int index, int value);
+// 得到从左往右第一个 0 的位置，按字节查找，分配器使用 findFirstZeroBit
 int getOffset(BYTE byte);
 
 int writeBlock(Disk* disk, unsigned int block_idx, void* block);
 int readBlock(Disk* disk, unsigned int block_idx, void* block);
+int writeBlocks(Disk* disk, DiskRequest* requests, unsigned int count);
+int readBlocks(Disk* disk, DiskRequest* requests, unsigned int count);
 
 char getCh();
 #endif  // __EXT2_H__
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include "extent.h"
+
+// 根节点在 inode 的 block 数组中，能放下的项数
+#define EXTENT_ROOT_MAX                                              \
+  ((sizeof(((Ext2Inode*)0)->block) - sizeof(Ext2ExtentHeader)) / \
+   sizeof(Ext2Extent))
+
+static Ext2ExtentHeader* nodeHeader(BYTE* node) {
+  return (Ext2ExtentHeader*)node;
+}
+
+static Ext2Extent* nodeExtents(BYTE* node) {
+  return (Ext2Extent*)(node + sizeof(Ext2ExtentHeader));
+}
+
+static Ext2ExtentIndex* nodeIndexes(BYTE* node) {
+  return (Ext2ExtentIndex*)(node + sizeof(Ext2ExtentHeader));
+}
+
+// 占一个块的节点能放下的项数
+static UINT16 nodeMax(Disk* disk) {
+  return (disk->layout->block_size - sizeof(Ext2ExtentHeader)) /
+         sizeof(Ext2Extent);
+}
+
+// 二分查找最后一个起始逻辑块号不超过 logical 的项，没有时返回 -1。
+// extent 和索引项的第一个字段都是 logical，可以按同样的方式查找
+static int searchNode(BYTE* node, UINT32 logical) {
+  Ext2Extent* entries = nodeExtents(node);
+  int lo = 0;
+  int hi = nodeHeader(node)->entries;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (entries[mid].logical <= logical) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo - 1;
+}
+
+// 根节点随 inode 一起写回，其余节点直接写入所在的块
+static int writeNode(Disk* disk, UINT32 block_idx, BYTE* node) {
+  if (block_idx == 0) {
+    return SUCCESS;
+  }
+  return writeBlock(disk, block_idx, node);
+}
+
+// 为树节点分配一个块，失败返回 0
+static UINT32 allocNode(Disk* disk) {
+  unsigned int got;
+  Ext2Location location = allocBlocks(disk, 0, 1, &got);
+  return got == 0 ? 0 : location.block_idx;
+}
+
+// 根节点已满时把它的内容移到一个新块中，根节点只保留指向该块的索引项
+static int growTree(Disk* disk, Ext2Inode* inode) {
+  UINT32 block_idx = allocNode(disk);
+  if (block_idx == 0) {
+    return FAILURE;
+  }
+  BYTE node[MAX_BLOCK_SIZE];
+  BYTE* root = (BYTE*)inode->block;
+  Ext2ExtentHeader* header = nodeHeader(root);
+  memset(node, 0, disk->layout->block_size);
+  memcpy(node, root,
+         sizeof(Ext2ExtentHeader) + header->entries * sizeof(Ext2Extent));
+  nodeHeader(node)->max = nodeMax(disk);
+  writeBlock(disk, block_idx, node);
+
+  UINT32 first = nodeExtents(root)[0].logical;
+  Ext2ExtentIndex* index = nodeIndexes(root);
+  index->logical = first;
+  index->leaf = block_idx;
+  index->unused = 0;
+  header->entries = 1;
+  header->depth++;
+  return SUCCESS;
+}
+
+void initExtentTree(Ext2Inode* inode) {
+  memset(inode->block, 0, sizeof(inode->block));
+  Ext2ExtentHeader* header = nodeHeader((BYTE*)inode->block);
+  header->magic = EXT2_EXTENT_MAGIC;
+  header->entries = 0;
+  header->max = EXTENT_ROOT_MAX;
+  header->depth = 0;
+  inode->flags |= EXT2_EXTENTS_FL;
+}
+
+UINT32 extentMapBlock(Disk* disk,
+                      Ext2Inode* inode,
+                      UINT32 logical,
+                      UINT32* run) {
+  BYTE buffer[MAX_BLOCK_SIZE];
+  BYTE* node = (BYTE*)inode->block;
+  // 每层只读一个节点，深度为 0 时不需要任何额外的读
+  for (int level = 0; nodeHeader(node)->depth > 0; level++) {
+    int i = searchNode(node, logical);
+    if (i < 0 || level >= EXT2_EXTENT_MAX_DEPTH ||
+        readBlock(disk, nodeIndexes(node)[i].leaf, buffer) == FAILURE) {
+      return 0;
+    }
+    node = buffer;
+    if (nodeHeader(node)->magic != EXT2_EXTENT_MAGIC) {
+      return 0;
+    }
+  }
+  int i = searchNode(node, logical);
+  if (i < 0) {
+    return 0;
+  }
+  Ext2Extent* extent = &nodeExtents(node)[i];
+  UINT32 offset = logical - extent->logical;
+  if (offset >= extent->len) {
+    return 0;
+  }
+  if (run != NULL) {
+    *run = extent->len - offset;
+  }
+  return extent->start + offset;
+}
+
+int extentAppend(Disk* disk,
+                 Ext2Inode* inode,
+                 UINT32 logical,
+                 UINT32 start,
+                 UINT32 len) {
+  BYTE buffers[EXT2_EXTENT_MAX_DEPTH][MAX_BLOCK_SIZE];
+  BYTE* path[EXT2_EXTENT_MAX_DEPTH + 1];
+  UINT32 blocks[EXT2_EXTENT_MAX_DEPTH + 1];
+  path[0] = (BYTE*)inode->block;
+  blocks[0] = 0;
+  UINT32 depth = nodeHeader(path[0])->depth;
+  if (depth > EXT2_EXTENT_MAX_DEPTH) {
+    return FAILURE;
+  }
+  // 追加只发生在文件末尾，沿每层最后一个索引项找到最后一个叶子
+  for (UINT32 k = 0; k < depth; k++) {
+    Ext2ExtentHeader* header = nodeHeader(path[k]);
+    blocks[k + 1] = nodeIndexes(path[k])[header->entries - 1].leaf;
+    if (readBlock(disk, blocks[k + 1], buffers[k]) == FAILURE) {
+      return FAILURE;
+    }
+    path[k + 1] = buffers[k];
+  }
+  BYTE* leaf = path[depth];
+  Ext2ExtentHeader* header = nodeHeader(leaf);
+  if (header->entries > 0) {
+    // 逻辑上和物理上都紧接着最后一个 extent 时直接延长
+    Ext2Extent* last = &nodeExtents(leaf)[header->entries - 1];
+    if (last->logical + last->len == logical &&
+        last->start + last->len == start) {
+      last->len += len;
+      return writeNode(disk, blocks[depth], leaf);
+    }
+  }
+  if (header->entries < header->max) {
+    Ext2Extent* extent = &nodeExtents(leaf)[header->entries++];
+    extent->logical = logical;
+    extent->start = start;
+    extent->len = len;
+    return writeNode(disk, blocks[depth], leaf);
+  }
+  // 叶子已满，自下而上找到还有空位的索引节点
+  int level = (int)depth - 1;
+  while (level >= 0 &&
+         nodeHeader(path[level])->entries == nodeHeader(path[level])->max) {
+    level--;
+  }
+  if (level < 0) {
+    // 整条路径都满了，树增高一层后根节点就有了空位
+    if (depth == EXT2_EXTENT_MAX_DEPTH || growTree(disk, inode) == FAILURE) {
+      return FAILURE;
+    }
+    return extentAppend(disk, inode, logical, start, len);
+  }
+  // 在 level 之下新建一条每层只有一项的路径，先分配好所有节点
+  UINT32 fresh[EXT2_EXTENT_MAX_DEPTH];
+  UINT32 n = depth - level;
+  for (UINT32 k = 0; k < n; k++) {
+    fresh[k] = allocNode(disk);
+    if (fresh[k] == 0) {
+      for (UINT32 j = 0; j < k; j++) {
+        freeBlock(disk, fresh[j]);
+      }
+      return FAILURE;
+    }
+  }
+  BYTE node[MAX_BLOCK_SIZE];
+  for (UINT32 k = 0; k < n; k++) {
+    memset(node, 0, disk->layout->block_size);
+    Ext2ExtentHeader* fresh_header = nodeHeader(node);
+    fresh_header->magic = EXT2_EXTENT_MAGIC;
+    fresh_header->entries = 1;
+    fresh_header->max = nodeMax(disk);
+    fresh_header->depth = n - 1 - k;
+    if (fresh_header->depth == 0) {
+      Ext2Extent* extent = nodeExtents(node);
+      extent->logical = logical;
+      extent->start = start;
+      extent->len = len;
+    } else {
+      Ext2ExtentIndex* index = nodeIndexes(node);
+      index->logical = logical;
+      index->leaf = fresh[k + 1];
+      index->unused = 0;
+    }
+    writeBlock(disk, fresh[k], node);
+  }
+  Ext2ExtentHeader* parent = nodeHeader(path[level]);
+  Ext2ExtentIndex* index = &nodeIndexes(path[level])[parent->entries++];
+  index->logical = logical;
+  index->leaf = fresh[0];
+  index->unused = 0;
+  return writeNode(disk, blocks[level], path[level]);
+}
+
+// 释放 node 所在子树中逻辑块号不小于 blocks 的部分，返回节点剩余的项数
+static UINT32 truncateNode(Disk* disk, BYTE* node, UINT32 blocks) {
+  Ext2ExtentHeader* header = nodeHeader(node);
+  if (header->depth == 0) {
+    Ext2Extent* extents = nodeExtents(node);
+    while (header->entries > 0) {
+      Ext2Extent* extent = &extents[header->entries - 1];
+      if (extent->logical >= blocks) {
+        freeBlocks(disk, extent->start, extent->len);
+        header->entries--;
+        continue;
+      }
+      if (extent->logical + extent->len > blocks) {
+        UINT32 keep = blocks - extent->logical;
+        freeBlocks(disk, extent->start + keep, extent->len - keep);
+        extent->len = keep;
+      }
+      break;
+    }
+    return header->entries;
+  }
+  BYTE child[MAX_BLOCK_SIZE];
+  while (header->entries > 0) {
+    Ext2ExtentIndex* index = &nodeIndexes(node)[header->entries - 1];
+    if (readBlock(disk, index->leaf, child) == FAILURE) {
+      break;
+    }
+    if (truncateNode(disk, child, blocks) > 0) {
+      writeBlock(disk, index->leaf, child);
+      break;
+    }
+    // 子节点已经为空，连同节点所在的块一起释放
+    freeBlock(disk, index->leaf);
+    header->entries--;
+  }
+  return header->entries;
+}
+
+int extentTruncate(Disk* disk, Ext2Inode* inode, UINT32 blocks) {
+  BYTE* root = (BYTE*)inode->block;
+  if (truncateNode(disk, root, blocks) == 0) {
+    // 树已经为空，回到只有根节点的状态
+    nodeHeader(root)->depth = 0;
+  }
+  return SUCCESS;
+}
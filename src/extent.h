@@ -0,0 +1,93 @@
+#ifndef __EXTENT_H__
+#define __EXTENT_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+#include "ext2.h"
+
+#define EXT2_EXTENT_MAGIC 0xF30A
+// 树的最大深度，512 字节的块在深度 3 时已能描述 2^32 个逻辑块
+#define EXT2_EXTENT_MAX_DEPTH 5
+
+/**
+ * @brief extent 树节点的头部，占用大小 8 bytes。根节点放在 inode 的 block
+ * 数组中，其余节点各占一个块
+ *
+ */
+typedef struct Ext2ExtentHeader {
+  UINT16 magic;    // EXT2_EXTENT_MAGIC
+  UINT16 entries;  // 节点中有效的项数
+  UINT16 max;      // 节点最多容纳的项数
+  UINT16 depth;    // 0 表示叶子节点，存放 extent；否则存放索引项
+} Ext2ExtentHeader;
+
+/**
+ * @brief 叶子节点中的一段连续映射，占用大小 12 bytes
+ *
+ */
+typedef struct Ext2Extent {
+  UINT32 logical;  // 第一个逻辑块号
+  UINT32 start;    // 第一个物理块号
+  UINT32 len;      // 块数
+} Ext2Extent;
+
+/**
+ * @brief 索引节点中的一项，指向下一层的节点，占用大小 12 bytes
+ *
+ */
+typedef struct Ext2ExtentIndex {
+  UINT32 logical;  // 子树中最小的逻辑块号
+  UINT32 leaf;     // 子节点所在的块
+  UINT32 unused;   // 填充，与 Ext2Extent 等长
+} Ext2ExtentIndex;
+
+/**
+ * @brief 把 inode 的 block 数组初始化为一棵空的 extent 树，并设置
+ * EXT2_EXTENTS_FL
+ *
+ * @param inode
+ */
+void initExtentTree(Ext2Inode* inode);
+
+/**
+ * @brief 查找第 logical 个逻辑块对应的物理块
+ *
+ * @param disk
+ * @param inode
+ * @param logical
+ * @param run 不为 NULL 时返回从该块起在同一个 extent 中的块数
+ * @return UINT32 物理块号，未映射时返回 0
+ */
+UINT32 extentMapBlock(Disk* disk, Ext2Inode* inode, UINT32 logical,
+                      UINT32* run);
+
+/**
+ * @brief 在文件末尾追加一段映射 [logical, logical + len) -> [start, ...)，
+ * 与最后一个 extent 首尾相接时直接合并。节点满时分配新块，根节点满时树增高
+ * 一层
+ *
+ * @param disk
+ * @param inode
+ * @param logical 不能小于已有映射的末尾
+ * @param start
+ * @param len
+ * @return int 分配不到树节点时返回 FAILURE，映射保持不变
+ */
+int extentAppend(Disk* disk, Ext2Inode* inode, UINT32 logical, UINT32 start,
+                 UINT32 len);
+
+/**
+ * @brief 释放逻辑块号不小于 blocks 的数据块，以及因此变空的树节点
+ *
+ * @param disk
+ * @param inode
+ * @param blocks 保留的逻辑块数，为 0 时释放整棵树
+ * @return int
+ */
+int extentTruncate(Disk* disk, Ext2Inode* inode, UINT32 blocks);
+
+#endif  // __EXTENT_H__
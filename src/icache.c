@@ -0,0 +1,417 @@
+#include "icache.h"
+
+static unsigned int hashInode(InodeCache* cache, unsigned int inode_idx) {
+  // 乘法哈希，hash_size 为 2 的幂
+  return (inode_idx * 2654435761u) & (cache->hash_size - 1);
+}
+
+static int lookupEntry(InodeCache* cache, unsigned int inode_idx) {
+  int i = cache->buckets[hashInode(cache, inode_idx)];
+  while (i != -1) {
+    if (cache->entries[i].inode_idx == inode_idx) {
+      return i;
+    }
+    i = cache->entries[i].hash_next;
+  }
+  return -1;
+}
+
+static void unlinkHash(InodeCache* cache, int i) {
+  int* p = &cache->buckets[hashInode(cache, cache->entries[i].inode_idx)];
+  while (*p != -1) {
+    if (*p == i) {
+      *p = cache->entries[i].hash_next;
+      return;
+    }
+    p = &cache->entries[*p].hash_next;
+  }
+}
+
+static void unlinkLru(InodeCache* cache, int i) {
+  InodeCacheEntry* e = &cache->entries[i];
+  if (e->lru_prev != -1) {
+    cache->entries[e->lru_prev].lru_next = e->lru_next;
+  } else {
+    cache->lru_head = e->lru_next;
+  }
+  if (e->lru_next != -1) {
+    cache->entries[e->lru_next].lru_prev = e->lru_prev;
+  } else {
+    cache->lru_tail = e->lru_prev;
+  }
+}
+
+static void pushLruHead(InodeCache* cache, int i) {
+  InodeCacheEntry* e = &cache->entries[i];
+  e->lru_prev = -1;
+  e->lru_next = cache->lru_head;
+  if (cache->lru_head != -1) {
+    cache->entries[cache->lru_head].lru_prev = i;
+  }
+  cache->lru_head = i;
+  if (cache->lru_tail == -1) {
+    cache->lru_tail = i;
+  }
+}
+
+static void pushLruTail(InodeCache* cache, int i) {
+  InodeCacheEntry* e = &cache->entries[i];
+  e->lru_next = -1;
+  e->lru_prev = cache->lru_tail;
+  if (cache->lru_tail != -1) {
+    cache->entries[cache->lru_tail].lru_next = i;
+  }
+  cache->lru_tail = i;
+  if (cache->lru_head == -1) {
+    cache->lru_head = i;
+  }
+}
+
+static void touchEntry(InodeCache* cache, int i) {
+  if (cache->lru_head != i) {
+    unlinkLru(cache, i);
+    pushLruHead(cache, i);
+  }
+}
+
+// 直接从 inode 表读取一个 inode
+static int loadInode(Disk* disk, unsigned int inode_idx, Ext2Inode* inode) {
+  BYTE block[MAX_BLOCK_SIZE];
+  Ext2Location location = getInodeLocation(disk, inode_idx);
+  if (readBlock(disk, location.block_idx, block) == FAILURE) {
+    return FAILURE;
+  }
+  memset(inode, 0, sizeof(Ext2Inode));
+  memcpy(inode, block + location.offset, INODE_SIZE);
+  return SUCCESS;
+}
+
+// 把一个 inode 写回 inode 表，同一块中的其他 inode 保持不变
+static int storeInode(Disk* disk, unsigned int inode_idx, Ext2Inode* inode) {
+  BYTE block[MAX_BLOCK_SIZE];
+  Ext2Location location = getInodeLocation(disk, inode_idx);
+  if (readBlock(disk, location.block_idx, block) == FAILURE) {
+    return FAILURE;
+  }
+  memcpy(block + location.offset, inode, INODE_SIZE);
+  return writeBlock(disk, location.block_idx, block);
+}
+
+// 一个待写回的脏 inode 及其在 inode 表中的位置
+typedef struct DirtyInode {
+  Ext2Location location;
+  InodeCacheEntry* entry;
+} DirtyInode;
+
+static int compareLocation(const void* a, const void* b) {
+  const Ext2Location* x = &((const DirtyInode*)a)->location;
+  const Ext2Location* y = &((const DirtyInode*)b)->location;
+  if (x->block_idx != y->block_idx) {
+    return (x->block_idx > y->block_idx) - (x->block_idx < y->block_idx);
+  }
+  return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// 把 dirty 中的 inode 按所在的 inode 表块分组写回，每个块只读写一次，
+// 所有块合并成一次批量读和一次批量写
+static int writeBackInodes(InodeCache* cache,
+                           Disk* disk,
+                           DirtyInode* dirty,
+                           unsigned int n) {
+  if (n == 0) {
+    return SUCCESS;
+  }
+  qsort(dirty, n, sizeof(DirtyInode), compareLocation);
+  unsigned int blocks = 1;
+  for (unsigned int i = 1; i < n; i++) {
+    blocks += dirty[i].location.block_idx != dirty[i - 1].location.block_idx;
+  }
+  unsigned int block_size = disk->layout->block_size;
+  BYTE* pool = (BYTE*)malloc((size_t)blocks * block_size);
+  DiskRequest* requests = (DiskRequest*)malloc(blocks * sizeof(DiskRequest));
+  if (pool == NULL || requests == NULL) {
+    free(pool);
+    free(requests);
+    return FAILURE;
+  }
+  unsigned int m = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    if (i == 0 ||
+        dirty[i].location.block_idx != dirty[i - 1].location.block_idx) {
+      requests[m].block_idx = dirty[i].location.block_idx;
+      requests[m].data = pool + (size_t)m * block_size;
+      m++;
+    }
+  }
+  int ret = readBlocks(disk, requests, blocks);
+  if (ret == SUCCESS) {
+    m = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      if (i > 0 &&
+          dirty[i].location.block_idx != dirty[i - 1].location.block_idx) {
+        m++;
+      }
+      memcpy((BYTE*)requests[m].data + dirty[i].location.offset,
+             &dirty[i].entry->inode, INODE_SIZE);
+    }
+    ret = writeBlocks(disk, requests, blocks);
+  }
+  if (ret == SUCCESS) {
+    for (unsigned int i = 0; i < n; i++) {
+      dirty[i].entry->dirty = 0;
+    }
+    cache->dirty_count -= n;
+    cache->writes += n;
+    cache->table_writes += blocks;
+  }
+  free(requests);
+  free(pool);
+  return ret;
+}
+
+// 写回与第 i 项位于同一 inode 表块的所有脏 inode
+static int writeBackBlockOf(InodeCache* cache, Disk* disk, int i) {
+  DirtyInode dirty[MAX_BLOCK_SIZE / INODE_SIZE];
+  unsigned int block_idx =
+      getInodeLocation(disk, cache->entries[i].inode_idx).block_idx;
+  unsigned int n = 0;
+  for (unsigned int k = 0; k < cache->capacity; k++) {
+    InodeCacheEntry* e = &cache->entries[k];
+    if (!e->valid || !e->dirty) {
+      continue;
+    }
+    Ext2Location location = getInodeLocation(disk, e->inode_idx);
+    if (location.block_idx == block_idx) {
+      dirty[n].location = location;
+      dirty[n].entry = e;
+      n++;
+    }
+  }
+  return writeBackInodes(cache, disk, dirty, n);
+}
+
+// 从 LRU 尾部取出最久未使用且未被引用的表项，重新挂到 inode_idx 对应的
+// 哈希链上。所有表项都被引用或换出的脏 inode 写回失败时返回 -1
+static int claimEntry(InodeCache* cache, Disk* disk, unsigned int inode_idx) {
+  int i = cache->lru_tail;
+  while (i != -1 && cache->entries[i].refcount > 0) {
+    i = cache->entries[i].lru_prev;
+  }
+  if (i == -1) {
+    return -1;
+  }
+  InodeCacheEntry* e = &cache->entries[i];
+  if (e->valid) {
+    if (e->dirty) {
+      // 被换出的脏 inode 需要先写回，同一块中的其他脏 inode 顺带写回。
+      // 写回失败时保留脏 inode，不占用这个表项
+      if (writeBackBlockOf(cache, disk, i) == FAILURE) {
+        return -1;
+      }
+    }
+    unlinkHash(cache, i);
+  }
+  e->inode_idx = inode_idx;
+  e->valid = 1;
+  unsigned int h = hashInode(cache, inode_idx);
+  e->hash_next = cache->buckets[h];
+  cache->buckets[h] = i;
+  return i;
+}
+
+// 找到 inode_idx 对应的表项，未命中时从 inode 表读入
+static int fetchEntry(InodeCache* cache, Disk* disk, unsigned int inode_idx) {
+  int i = lookupEntry(cache, inode_idx);
+  if (i != -1) {
+    cache->hits++;
+    touchEntry(cache, i);
+    return i;
+  }
+  cache->misses++;
+  i = claimEntry(cache, disk, inode_idx);
+  if (i == -1) {
+    return -1;
+  }
+  if (loadInode(disk, inode_idx, &cache->entries[i].inode) == FAILURE) {
+    unlinkHash(cache, i);
+    cache->entries[i].valid = 0;
+    return -1;
+  }
+  touchEntry(cache, i);
+  return i;
+}
+
+InodeCache* createInodeCache(unsigned int capacity) {
+  if (capacity == 0) {
+    capacity = DEFAULT_INODE_CACHE;
+  }
+  InodeCache* cache = (InodeCache*)malloc(sizeof(InodeCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+  cache->capacity = capacity;
+  cache->hash_size = 1;
+  while (cache->hash_size < capacity) {
+    cache->hash_size <<= 1;
+  }
+  cache->buckets = (int*)malloc(cache->hash_size * sizeof(int));
+  cache->entries =
+      (InodeCacheEntry*)malloc(capacity * sizeof(InodeCacheEntry));
+  if (cache->buckets == NULL || cache->entries == NULL) {
+    free(cache->buckets);
+    free(cache->entries);
+    free(cache);
+    return NULL;
+  }
+  for (unsigned int i = 0; i < cache->hash_size; i++) {
+    cache->buckets[i] = -1;
+  }
+  cache->lru_head = -1;
+  cache->lru_tail = -1;
+  for (unsigned int i = 0; i < capacity; i++) {
+    cache->entries[i].valid = 0;
+    cache->entries[i].dirty = 0;
+    cache->entries[i].refcount = 0;
+    cache->entries[i].hash_next = -1;
+    pushLruHead(cache, i);
+  }
+  cache->dirty_count = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->writes = 0;
+  cache->table_writes = 0;
+  return cache;
+}
+
+void destroyInodeCache(InodeCache* cache) {
+  if (cache == NULL) {
+    return;
+  }
+  free(cache->buckets);
+  free(cache->entries);
+  free(cache);
+}
+
+int cacheReadInode(InodeCache* cache,
+                   Disk* disk,
+                   unsigned int inode_idx,
+                   Ext2Inode* inode) {
+  int i = fetchEntry(cache, disk, inode_idx);
+  if (i == -1) {
+    // 没有可用的表项，绕过缓存
+    return loadInode(disk, inode_idx, inode);
+  }
+  memset(inode, 0, sizeof(Ext2Inode));
+  memcpy(inode, &cache->entries[i].inode, INODE_SIZE);
+  return SUCCESS;
+}
+
+int peekInode(InodeCache* cache, unsigned int inode_idx, Ext2Inode* inode) {
+  int i = lookupEntry(cache, inode_idx);
+  if (i == -1) {
+    return FAILURE;
+  }
+  cache->hits++;
+  touchEntry(cache, i);
+  memset(inode, 0, sizeof(Ext2Inode));
+  memcpy(inode, &cache->entries[i].inode, INODE_SIZE);
+  return SUCCESS;
+}
+
+int cacheWriteInode(InodeCache* cache,
+                    Disk* disk,
+                    unsigned int inode_idx,
+                    Ext2Inode* inode) {
+  // 整个 inode 都会被覆盖，未命中时不需要先读 inode 表
+  int i = lookupEntry(cache, inode_idx);
+  if (i == -1) {
+    i = claimEntry(cache, disk, inode_idx);
+  }
+  if (i == -1) {
+    cache->writes++;
+    cache->table_writes++;
+    return storeInode(disk, inode_idx, inode);
+  }
+  touchEntry(cache, i);
+  memcpy(&cache->entries[i].inode, inode, INODE_SIZE);
+  if (!cache->entries[i].dirty) {
+    // 同一 inode 的多次修改只会写一次 inode 表
+    cache->entries[i].dirty = 1;
+    cache->dirty_count++;
+  }
+  return SUCCESS;
+}
+
+Ext2Inode* acquireInode(InodeCache* cache, Disk* disk, unsigned int inode_idx) {
+  int i = fetchEntry(cache, disk, inode_idx);
+  if (i == -1) {
+    return NULL;
+  }
+  cache->entries[i].refcount++;
+  return &cache->entries[i].inode;
+}
+
+void releaseInode(InodeCache* cache, unsigned int inode_idx) {
+  int i = lookupEntry(cache, inode_idx);
+  if (i != -1 && cache->entries[i].refcount > 0) {
+    cache->entries[i].refcount--;
+  }
+}
+
+void forgetInode(InodeCache* cache, unsigned int inode_idx) {
+  int i = lookupEntry(cache, inode_idx);
+  if (i == -1 || cache->entries[i].refcount > 0) {
+    return;
+  }
+  InodeCacheEntry* e = &cache->entries[i];
+  // 已释放的 inode 不需要写回，空出的表项放到 LRU 尾部优先复用
+  if (e->dirty) {
+    e->dirty = 0;
+    cache->dirty_count--;
+  }
+  unlinkHash(cache, i);
+  e->valid = 0;
+  unlinkLru(cache, i);
+  pushLruTail(cache, i);
+}
+
+int flushInodeCache(InodeCache* cache, Disk* disk) {
+  if (cache->dirty_count == 0) {
+    return SUCCESS;
+  }
+  DirtyInode* dirty =
+      (DirtyInode*)malloc(cache->dirty_count * sizeof(DirtyInode));
+  if (dirty == NULL) {
+    return FAILURE;
+  }
+  unsigned int n = 0;
+  for (unsigned int i = 0; i < cache->capacity; i++) {
+    InodeCacheEntry* e = &cache->entries[i];
+    if (e->valid && e->dirty) {
+      dirty[n].location = getInodeLocation(disk, e->inode_idx);
+      dirty[n].entry = e;
+      n++;
+    }
+  }
+  int ret = writeBackInodes(cache, disk, dirty, n);
+  free(dirty);
+  return ret;
+}
+
+void printInodeCacheInfo(InodeCache* cache) {
+  unsigned long long total = cache->hits + cache->misses;
+  unsigned int pinned = 0;
+  for (unsigned int i = 0; i < cache->capacity; i++) {
+    pinned += cache->entries[i].refcount > 0;
+  }
+  printf("Inode Cache Info:\n");
+  printf("    Capacity: %u inodes\n", cache->capacity);
+  printf("    Pinned: %u\n", pinned);
+  printf("    Hits: %llu\n", cache->hits);
+  printf("    Misses: %llu\n", cache->misses);
+  printf("    Hit Rate: %.2f%%\n",
+         total == 0 ? 0.0 : 100.0 * cache->hits / total);
+  printf("    Dirty Inodes: %u\n", cache->dirty_count);
+  printf("    Inode Writes: %llu\n", cache->writes);
+  printf("    Table Block Writes: %llu\n", cache->table_writes);
+}
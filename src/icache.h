@@ -0,0 +1,142 @@
+#ifndef __ICACHE_H__
+#define __ICACHE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+#include "ext2.h"
+
+#define DEFAULT_INODE_CACHE 128
+
+/**
+ * @brief 缓存中的一个 inode，同时挂在哈希链和 LRU 链表上
+ *
+ */
+typedef struct InodeCacheEntry {
+  unsigned int inode_idx;  // 缓存的 inode 序号
+  int valid;               // 是否存放了有效数据
+  int dirty;               // 是否有尚未写回 inode 表的修改
+  unsigned int refcount;   // 引用计数，大于 0 时不会被换出
+  int hash_next;           // 哈希链中的下一个表项，-1 表示结束
+  int lru_prev;            // LRU 链表中更新的一项
+  int lru_next;            // LRU 链表中更旧的一项
+  Ext2Inode inode;         // inode 的内存副本
+} InodeCacheEntry;
+
+/**
+ * @brief inode 缓存，位于 getInode/writeInode 与 inode 表之间
+ *
+ */
+typedef struct InodeCache {
+  unsigned int capacity;           // 最多缓存的 inode 数
+  unsigned int hash_size;          // 哈希桶个数，2 的幂
+  int* buckets;                    // 哈希桶，存放表项下标
+  InodeCacheEntry* entries;        // 表项数组
+  int lru_head;                    // 最近使用的表项
+  int lru_tail;                    // 最久未使用的表项
+  unsigned int dirty_count;        // 脏 inode 个数
+  unsigned long long hits;         // 命中次数
+  unsigned long long misses;       // 未命中次数
+  unsigned long long writes;       // 写回 inode 表的 inode 数
+  unsigned long long table_writes; // 写回 inode 表的块数
+} InodeCache;
+
+/**
+ * @brief 创建一个容量为 capacity 个 inode 的缓存
+ *
+ * @param capacity 缓存的 inode 数，为 0 时使用 DEFAULT_INODE_CACHE
+ * @return InodeCache* 失败返回 NULL
+ */
+InodeCache* createInodeCache(unsigned int capacity);
+
+/**
+ * @brief 释放缓存占用的内存，调用前应先 flushInodeCache
+ *
+ * @param cache
+ */
+void destroyInodeCache(InodeCache* cache);
+
+/**
+ * @brief 通过缓存读取第 inode_idx 个 inode，未命中时从 inode 表读入
+ *
+ * @param cache
+ * @param disk
+ * @param inode_idx
+ * @param inode
+ * @return int
+ */
+int cacheReadInode(InodeCache* cache, Disk* disk, unsigned int inode_idx,
+                   Ext2Inode* inode);
+
+/**
+ * @brief 只在缓存中查找第 inode_idx 个 inode，未命中时既不读 inode 表也不
+ * 占用表项。批量读 inode 时用它取得比 inode 表更新的副本
+ *
+ * @param cache
+ * @param inode_idx
+ * @param inode
+ * @return int 未命中时返回 FAILURE
+ */
+int peekInode(InodeCache* cache, unsigned int inode_idx, Ext2Inode* inode);
+
+/**
+ * @brief 用 inode 更新缓存中的副本并标记为脏，由 flushInodeCache 或换出时
+ * 写回 inode 表
+ *
+ * @param cache
+ * @param disk
+ * @param inode_idx
+ * @param inode
+ * @return int
+ */
+int cacheWriteInode(InodeCache* cache, Disk* disk, unsigned int inode_idx,
+                    Ext2Inode* inode);
+
+/**
+ * @brief 把第 inode_idx 个 inode 读入缓存并增加引用计数，被引用的 inode
+ * 常驻缓存，直到 releaseInode
+ *
+ * @param cache
+ * @param disk
+ * @param inode_idx
+ * @return Ext2Inode* 缓存中的副本，所有表项都被引用时返回 NULL
+ */
+Ext2Inode* acquireInode(InodeCache* cache, Disk* disk, unsigned int inode_idx);
+
+/**
+ * @brief 减少第 inode_idx 个 inode 的引用计数
+ *
+ * @param cache
+ * @param inode_idx
+ */
+void releaseInode(InodeCache* cache, unsigned int inode_idx);
+
+/**
+ * @brief 丢弃第 inode_idx 个 inode 的缓存副本，inode 被释放时调用。
+ * 仍被引用的 inode 保留在缓存中
+ *
+ * @param cache
+ * @param inode_idx
+ */
+void forgetInode(InodeCache* cache, unsigned int inode_idx);
+
+/**
+ * @brief 把所有脏 inode 按所在的 inode 表块分组写回，每个块只写一次
+ *
+ * @param cache
+ * @param disk
+ * @return int
+ */
+int flushInodeCache(InodeCache* cache, Disk* disk);
+
+/**
+ * @brief 输出缓存的命中统计
+ *
+ * @param cache
+ */
+void printInodeCacheInfo(InodeCache* cache);
+
+#endif  // __ICACHE_H__
@@ -0,0 +1,320 @@
+#include "indirect.h"
+
+// 计算第 logical 个逻辑块在 block 数组和各级索引块中的下标，
+// 返回路径长度，1 表示直接索引，超出三级索引的范围时返回 0
+static int blockPath(UINT32 addrs_per_block, UINT32 logical,
+                     UINT32 offsets[4]) {
+  UINT64 apb = addrs_per_block;
+  UINT64 rest = logical;
+  if (rest < EXT2_NDIR_BLOCKS) {
+    offsets[0] = rest;
+    return 1;
+  }
+  rest -= EXT2_NDIR_BLOCKS;
+  if (rest < apb) {
+    offsets[0] = EXT2_IND_BLOCK;
+    offsets[1] = rest;
+    return 2;
+  }
+  rest -= apb;
+  if (rest < apb * apb) {
+    offsets[0] = EXT2_DIND_BLOCK;
+    offsets[1] = rest / apb;
+    offsets[2] = rest % apb;
+    return 3;
+  }
+  rest -= apb * apb;
+  if (rest < apb * apb * apb) {
+    offsets[0] = EXT2_TIND_BLOCK;
+    offsets[1] = rest / (apb * apb);
+    offsets[2] = rest / apb % apb;
+    offsets[3] = rest % apb;
+    return 4;
+  }
+  return 0;
+}
+
+// 一级和二级索引的根在 block 数组中，三级索引的根是单独的 tind_block
+static UINT32* rootSlot(Ext2Inode* inode, UINT32 slot) {
+  return slot == EXT2_TIND_BLOCK ? &inode->tind_block : &inode->block[slot];
+}
+
+static void writeSlot(Disk* disk, Ext2MapSlot* slot) {
+  writeBlock(disk, slot->block_idx, slot->addrs);
+  slot->dirty = 0;
+}
+
+// 取出最久未使用的槽位，其中的脏索引块先写回
+static Ext2MapSlot* claimSlot(Disk* disk, UINT32 block_idx) {
+  Ext2Layout* layout = disk->layout;
+  Ext2MapSlot* victim = &layout->map_cache[0];
+  for (int i = 1; i < EXT2_MAP_CACHE_SLOTS; i++) {
+    if (layout->map_cache[i].last_use < victim->last_use) {
+      victim = &layout->map_cache[i];
+    }
+  }
+  if (victim->block_idx != 0 && victim->dirty) {
+    writeSlot(disk, victim);
+  }
+  victim->block_idx = block_idx;
+  victim->dirty = 0;
+  victim->last_use = ++layout->map_clock;
+  return victim;
+}
+
+// 文件在已解析映射表中的槽位，每个文件占一个，哈希冲突的文件互相替换
+static Ext2MapRun* runSlot(Ext2Layout* layout, UINT32 owner) {
+  return &layout->map_runs[(owner * 2654435761u) & (EXT2_MAP_RUN_SLOTS - 1)];
+}
+
+// 通过映射缓存读取索引块，返回的内容在下一次访问缓存之前有效
+static Ext2MapSlot* getIndexBlock(Disk* disk, UINT32 block_idx) {
+  Ext2Layout* layout = disk->layout;
+  for (int i = 0; i < EXT2_MAP_CACHE_SLOTS; i++) {
+    if (layout->map_cache[i].block_idx == block_idx) {
+      layout->map_hits++;
+      layout->map_cache[i].last_use = ++layout->map_clock;
+      return &layout->map_cache[i];
+    }
+  }
+  layout->map_misses++;
+  Ext2MapSlot* slot = claimSlot(disk, block_idx);
+  if (readBlock(disk, block_idx, slot->addrs) == FAILURE) {
+    slot->block_idx = 0;
+    slot->last_use = 0;
+    return NULL;
+  }
+  return slot;
+}
+
+// 分配一个全零的索引块，只在缓存中建立，随其他脏索引块一起写回
+static UINT32 newIndexBlock(Disk* disk) {
+  unsigned int got;
+  Ext2Location location = allocBlocks(disk, 0, 1, &got);
+  if (got == 0) {
+    return 0;
+  }
+  Ext2MapSlot* slot = claimSlot(disk, location.block_idx);
+  memset(slot->addrs, 0, disk->layout->block_size);
+  slot->dirty = 1;
+  return location.block_idx;
+}
+
+static void flushIndexBlocks(Disk* disk) {
+  Ext2Layout* layout = disk->layout;
+  for (int i = 0; i < EXT2_MAP_CACHE_SLOTS; i++) {
+    if (layout->map_cache[i].block_idx != 0 && layout->map_cache[i].dirty) {
+      writeSlot(disk, &layout->map_cache[i]);
+    }
+  }
+}
+
+UINT32 indirectMapBlock(Disk* disk,
+                        Ext2Inode* inode,
+                        UINT32 logical,
+                        UINT32* run) {
+  Ext2Layout* layout = disk->layout;
+  UINT32 offsets[4];
+  int n = blockPath(layout->addrs_per_block, logical, offsets);
+  if (n == 0) {
+    return 0;
+  }
+  // 经过索引块的映射先查这个文件上次解析出的连续映射
+  Ext2MapRun* cached = NULL;
+  if (n > 1 && inode->block[EXT2_IND_BLOCK] != 0) {
+    cached = runSlot(layout, inode->block[EXT2_IND_BLOCK]);
+    if (cached->owner == inode->block[EXT2_IND_BLOCK] &&
+        logical - cached->logical < cached->len) {
+      layout->run_hits++;
+      UINT32 skip = logical - cached->logical;
+      if (run != NULL) {
+        *run = cached->len - skip;
+      }
+      return cached->physical + skip;
+    }
+  }
+  UINT32* addrs = inode->block;
+  UINT32 count = n == 1 ? EXT2_NDIR_BLOCKS : layout->addrs_per_block;
+  for (int k = 1; k < n; k++) {
+    UINT32 block_idx =
+        k == 1 ? *rootSlot(inode, offsets[0]) : addrs[offsets[k - 1]];
+    Ext2MapSlot* slot = block_idx == 0 ? NULL : getIndexBlock(disk, block_idx);
+    if (slot == NULL) {
+      return 0;
+    }
+    addrs = slot->addrs;
+  }
+  UINT32 i = offsets[n - 1];
+  if ((run != NULL || cached != NULL) && addrs[i] != 0) {
+    // 同一个索引块中之后物理上连续的块不需要再查找
+    UINT32 len = 1;
+    while (i + len < count && addrs[i + len] == addrs[i] + len) {
+      len++;
+    }
+    if (run != NULL) {
+      *run = len;
+    }
+    if (cached != NULL) {
+      cached->owner = inode->block[EXT2_IND_BLOCK];
+      cached->logical = logical;
+      cached->physical = addrs[i];
+      cached->len = len;
+    }
+  }
+  return addrs[i];
+}
+
+int indirectAppend(Disk* disk,
+                   Ext2Inode* inode,
+                   UINT32 logical,
+                   UINT32 start,
+                   UINT32 len) {
+  Ext2Layout* layout = disk->layout;
+  int ret = SUCCESS;
+  for (UINT32 j = 0; j < len && ret == SUCCESS; j++) {
+    UINT32 offsets[4];
+    int n = blockPath(layout->addrs_per_block, logical + j, offsets);
+    if (n == 0) {
+      ret = FAILURE;
+      break;
+    }
+    if (n == 1) {
+      inode->block[offsets[0]] = start + j;
+      continue;
+    }
+    UINT32* root = rootSlot(inode, offsets[0]);
+    if (*root == 0 && (*root = newIndexBlock(disk)) == 0) {
+      ret = FAILURE;
+      break;
+    }
+    // 逐级向下，缺少的索引块当场分配
+    UINT32 block_idx = *root;
+    for (int k = 1; k < n; k++) {
+      Ext2MapSlot* slot = getIndexBlock(disk, block_idx);
+      if (slot == NULL) {
+        ret = FAILURE;
+        break;
+      }
+      if (k == n - 1) {
+        slot->addrs[offsets[k]] = start + j;
+        slot->dirty = 1;
+        break;
+      }
+      if (slot->addrs[offsets[k]] == 0) {
+        UINT32 child = newIndexBlock(disk);
+        if (child == 0) {
+          ret = FAILURE;
+          break;
+        }
+        // 分配子索引块可能换出了父索引块，重新取一次
+        slot = getIndexBlock(disk, block_idx);
+        if (slot == NULL) {
+          ret = FAILURE;
+          break;
+        }
+        slot->addrs[offsets[k]] = child;
+        slot->dirty = 1;
+      }
+      block_idx = slot->addrs[offsets[k]];
+    }
+  }
+  // 同一个索引块的多次修改只写一次
+  flushIndexBlocks(disk);
+  return ret;
+}
+
+// 释放以 block_idx 为根、深度为 depth 的子树中第 keep 个逻辑块之后的部分，
+// depth 为 0 时 block_idx 是数据块。返回子树是否已经整个释放
+static int truncateTree(Disk* disk, UINT32 block_idx, int depth, UINT64 keep) {
+  if (depth == 0) {
+    if (keep == 0) {
+      freeBlock(disk, block_idx);
+      return 1;
+    }
+    return 0;
+  }
+  Ext2Layout* layout = disk->layout;
+  UINT32 addrs[MAX_BLOCK_SIZE / sizeof(UINT32)];
+  Ext2MapSlot* slot = getIndexBlock(disk, block_idx);
+  if (slot == NULL) {
+    return 0;
+  }
+  memcpy(addrs, slot->addrs, layout->block_size);
+  UINT64 span = 1;
+  for (int k = 1; k < depth; k++) {
+    span *= layout->addrs_per_block;
+  }
+  int empty = 1;
+  int changed = 0;
+  for (UINT32 i = 0; i < layout->addrs_per_block; i++) {
+    if (addrs[i] == 0) {
+      continue;
+    }
+    UINT64 first = i * span;
+    if (first + span <= keep) {
+      empty = 0;
+      continue;
+    }
+    if (truncateTree(disk, addrs[i], depth - 1, keep > first ? keep - first
+                                                             : 0)) {
+      addrs[i] = 0;
+      changed = 1;
+    } else {
+      empty = 0;
+    }
+  }
+  if (empty) {
+    freeBlock(disk, block_idx);
+    return 1;
+  }
+  if (changed) {
+    // 子树中可能换出过这个索引块，重新放回缓存再写
+    slot = getIndexBlock(disk, block_idx);
+    if (slot != NULL) {
+      memcpy(slot->addrs, addrs, layout->block_size);
+      writeSlot(disk, slot);
+    }
+  }
+  return 0;
+}
+
+int indirectTruncate(Disk* disk, Ext2Inode* inode, UINT32 blocks) {
+  Ext2Layout* layout = disk->layout;
+  // 释放的数据块和索引块之后会被复用，这个文件已解析的映射不再可信
+  if (inode->block[EXT2_IND_BLOCK] != 0) {
+    Ext2MapRun* cached = runSlot(layout, inode->block[EXT2_IND_BLOCK]);
+    if (cached->owner == inode->block[EXT2_IND_BLOCK]) {
+      cached->owner = 0;
+    }
+  }
+  for (UINT32 i = blocks; i < EXT2_NDIR_BLOCKS; i++) {
+    if (inode->block[i] != 0) {
+      freeBlock(disk, inode->block[i]);
+      inode->block[i] = 0;
+    }
+  }
+  UINT64 keep = blocks > EXT2_NDIR_BLOCKS ? blocks - EXT2_NDIR_BLOCKS : 0;
+  UINT64 span = layout->addrs_per_block;
+  for (int depth = 1; depth <= 3; depth++) {
+    UINT32* root = rootSlot(inode, EXT2_IND_BLOCK + depth - 1);
+    if (*root != 0 && truncateTree(disk, *root, depth, keep)) {
+      *root = 0;
+    }
+    keep = keep > span ? keep - span : 0;
+    span *= layout->addrs_per_block;
+  }
+  return SUCCESS;
+}
+
+void forgetIndexBlocks(Disk* disk, UINT32 start, UINT32 count) {
+  Ext2Layout* layout = disk->layout;
+  for (int i = 0; i < EXT2_MAP_CACHE_SLOTS; i++) {
+    Ext2MapSlot* slot = &layout->map_cache[i];
+    if (slot->block_idx >= start && slot->block_idx - start < count) {
+      // 已释放的块不再是索引块，尚未写回的修改也不再需要
+      slot->block_idx = 0;
+      slot->dirty = 0;
+      slot->last_use = 0;
+    }
+  }
+}
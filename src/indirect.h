@@ -0,0 +1,63 @@
+#ifndef __INDIRECT_H__
+#define __INDIRECT_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+#include "ext2.h"
+
+/**
+ * @brief 通过 block 数组的直接、一级、二级和三级索引查找第 logical 个逻辑块
+ * 对应的物理块。
+ *
+ * 缓存分两层：每个文件记住上次解析出的一段连续映射 (同一个索引块之内)，
+ * 按文件的一级索引块号哈希到 EXT2_MAP_RUN_SLOTS 个槽位，顺序读多个文件时
+ * 互不干扰，只有哈希冲突的文件互相替换；未命中时再经过所有文件共用的
+ * EXT2_MAP_CACHE_SLOTS 个索引块的 LRU 缓存。截断文件时丢弃它的映射
+ *
+ * @param disk
+ * @param inode
+ * @param logical
+ * @param run 不为 NULL 时返回从该块起、同一个索引块内物理上连续的块数
+ * @return UINT32 物理块号，未映射时返回 0
+ */
+UINT32 indirectMapBlock(Disk* disk, Ext2Inode* inode, UINT32 logical,
+                        UINT32* run);
+
+/**
+ * @brief 把逻辑块 [logical, logical + len) 映射到物理块 [start, ...)，
+ * 需要时分配各级索引块
+ *
+ * @param disk
+ * @param inode
+ * @param logical
+ * @param start
+ * @param len
+ * @return int 超出三级索引的范围或分配不到索引块时返回 FAILURE
+ */
+int indirectAppend(Disk* disk, Ext2Inode* inode, UINT32 logical, UINT32 start,
+                   UINT32 len);
+
+/**
+ * @brief 释放逻辑块号不小于 blocks 的数据块，以及因此变空的索引块
+ *
+ * @param disk
+ * @param inode
+ * @param blocks 保留的逻辑块数
+ * @return int
+ */
+int indirectTruncate(Disk* disk, Ext2Inode* inode, UINT32 blocks);
+
+/**
+ * @brief 块被释放时从映射缓存中丢弃 [start, start + count) 中的索引块
+ *
+ * @param disk
+ * @param start
+ * @param count
+ */
+void forgetIndexBlocks(Disk* disk, UINT32 start, UINT32 count);
+
+#endif  // __INDIRECT_H__
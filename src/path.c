@@ -0,0 +1,226 @@
+#include "path.h"
+
+// 根目录占用第 0 个 inode
+#define ROOT_INODE 0
+
+int normalizePath(const char* base, const char* path, char* out) {
+  // 构造过程中根目录表示为空串，每个文件名前带一个 "/"
+  size_t len = 0;
+  if (path[0] != '/') {
+    len = strlen(base);
+    if (len >= EXT2_PATH_MAX) {
+      return FAILURE;
+    }
+    memcpy(out, base, len);
+    if (len == 1) {
+      len = 0;
+    }
+  }
+  const char* p = path;
+  while (*p != '\0') {
+    while (*p == '/') {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    const char* end = p;
+    while (*end != '\0' && *end != '/') {
+      end++;
+    }
+    size_t n = end - p;
+    if (n == 2 && p[0] == '.' && p[1] == '.') {
+      while (len > 0 && out[len - 1] != '/') {
+        len--;
+      }
+      if (len > 0) {
+        len--;
+      }
+    } else if (n != 1 || p[0] != '.') {
+      if (len + 1 + n >= EXT2_PATH_MAX) {
+        return FAILURE;
+      }
+      out[len++] = '/';
+      memcpy(out + len, p, n);
+      len += n;
+    }
+    p = end;
+  }
+  if (len == 0) {
+    out[len++] = '/';
+  }
+  out[len] = '\0';
+  return SUCCESS;
+}
+
+// 找出 path 在前缀缓存中最长的已解析前缀，返回前缀长度，没有时返回 0，
+// 表示从根目录开始
+static size_t cachedPrefix(Ext2FileSystem* file_system,
+                           const char* path,
+                           unsigned int* inode_idx) {
+  size_t best = 0;
+  *inode_idx = ROOT_INODE;
+  // 当前目录总是已知的前缀
+  const char* prefix = file_system->cwd_path;
+  size_t n = strlen(prefix);
+  if (n > 1 && !strncmp(path, prefix, n) &&
+      (path[n] == '/' || path[n] == '\0')) {
+    best = n;
+    *inode_idx = file_system->cwd;
+  }
+  Ext2PathSlot* hit = NULL;
+  for (int i = 0; i < EXT2_PATH_CACHE_SLOTS; i++) {
+    Ext2PathSlot* slot = &file_system->path_cache[i];
+    n = strlen(slot->path);
+    if (n > best && !strncmp(path, slot->path, n) &&
+        (path[n] == '/' || path[n] == '\0')) {
+      best = n;
+      hit = slot;
+    }
+  }
+  if (hit != NULL) {
+    *inode_idx = hit->inode_idx;
+    hit->last_use = ++file_system->path_clock;
+  }
+  return best;
+}
+
+// 把解析到的目录记入前缀缓存，替换最久未使用的槽位
+static void rememberPath(Ext2FileSystem* file_system,
+                         const char* path,
+                         unsigned int inode_idx) {
+  if (!strcmp(path, "/") || !strcmp(path, file_system->cwd_path)) {
+    return;
+  }
+  Ext2PathSlot* victim = &file_system->path_cache[0];
+  for (int i = 0; i < EXT2_PATH_CACHE_SLOTS; i++) {
+    Ext2PathSlot* slot = &file_system->path_cache[i];
+    if (!strcmp(slot->path, path)) {
+      victim = slot;
+      break;
+    }
+    if (slot->last_use < victim->last_use) {
+      victim = slot;
+    }
+  }
+  strcpy(victim->path, path);
+  victim->inode_idx = inode_idx;
+  victim->last_use = ++file_system->path_clock;
+}
+
+// 从目录 start 开始逐级查找 rest 中的文件名
+static int walkPath(Ext2FileSystem* file_system,
+                    unsigned int start,
+                    const char* rest,
+                    Ext2DirEntry* entry,
+                    Ext2Inode* inode) {
+  Disk* disk = file_system->disk;
+  memset(entry, 0, DIR_SIZE);
+  entry->inode = start;
+  entry->file_type = EXT2_DIR;
+  strcpy(entry->name, start == ROOT_INODE ? "/" : ".");
+  if (getInode(disk, start, inode) == FAILURE) {
+    return FAILURE;
+  }
+  char name[DIR_NAME_LEN];
+  const char* p = rest;
+  while (*p != '\0') {
+    while (*p == '/') {
+      p++;
+    }
+    if (*p == '\0') {
+      break;
+    }
+    const char* end = p;
+    while (*end != '\0' && *end != '/') {
+      end++;
+    }
+    size_t n = end - p;
+    if (entry->file_type != EXT2_DIR || n >= DIR_NAME_LEN) {
+      // 文件之下没有下一级，过长的文件名也不可能存在
+      return FAILURE;
+    }
+    memcpy(name, p, n);
+    name[n] = '\0';
+    unsigned int dir_idx = entry->inode;
+    unsigned int index;
+    if (findDirEntry(disk, dir_idx, inode, name, entry, &index) == FAILURE ||
+        getInode(disk, entry->inode, inode) == FAILURE) {
+      return FAILURE;
+    }
+    p = end;
+  }
+  return SUCCESS;
+}
+
+int resolvePath(Ext2FileSystem* file_system,
+                unsigned int cwd,
+                const char* path,
+                Ext2DirEntry* entry,
+                Ext2Inode* inode) {
+  if (path[0] != '/' && cwd != file_system->cwd) {
+    // 不知道 cwd 的绝对路径，只能从 cwd 逐级查找，".." 按目录项查找
+    return walkPath(file_system, cwd, path, entry, inode);
+  }
+  char full[EXT2_PATH_MAX];
+  if (normalizePath(file_system->cwd_path, path, full) == FAILURE) {
+    return FAILURE;
+  }
+  unsigned int start;
+  size_t prefix = cachedPrefix(file_system, full, &start);
+  if (walkPath(file_system, start, full + prefix, entry, inode) == FAILURE) {
+    return FAILURE;
+  }
+  if (entry->file_type == EXT2_DIR && full[prefix] != '\0') {
+    rememberPath(file_system, full, entry->inode);
+  }
+  return SUCCESS;
+}
+
+int resolveParent(Ext2FileSystem* file_system,
+                  unsigned int cwd,
+                  const char* path,
+                  unsigned int* dir_idx,
+                  Ext2Inode* dir,
+                  char* name) {
+  char parent[EXT2_PATH_MAX];
+  size_t len = strlen(path);
+  if (len >= EXT2_PATH_MAX) {
+    return FAILURE;
+  }
+  strcpy(parent, path);
+  // 去掉结尾的 "/"，"a/b/" 和 "a/b" 是同一个文件
+  while (len > 1 && parent[len - 1] == '/') {
+    parent[--len] = '\0';
+  }
+  char* slash = strrchr(parent, '/');
+  const char* leaf;
+  if (slash == NULL) {
+    leaf = parent;
+  } else {
+    leaf = slash + 1;
+  }
+  if (*leaf == '\0') {
+    return FAILURE;
+  }
+  strcpy(name, leaf);
+  if (slash == NULL) {
+    strcpy(parent, ".");
+  } else if (slash == parent) {
+    strcpy(parent, "/");
+  } else {
+    *slash = '\0';
+  }
+  Ext2DirEntry entry;
+  if (resolvePath(file_system, cwd, parent, &entry, dir) == FAILURE ||
+      entry.file_type != EXT2_DIR) {
+    return FAILURE;
+  }
+  *dir_idx = entry.inode;
+  return SUCCESS;
+}
+
+void forgetPaths(Ext2FileSystem* file_system) {
+  memset(file_system->path_cache, 0, sizeof(file_system->path_cache));
+  file_system->path_clock = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef __PATH_H__
+#define __PATH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "ext2.h"
+
+/**
+ * @brief 把 path 规范化为不含 "."、".." 和多余 "/" 的绝对路径。".." 按
+ * 文本去掉前一个文件名，根目录的上级还是根目录
+ *
+ * @param base path 为相对路径时的起点，必须是规范化的绝对路径
+ * @param path
+ * @param out 至少 EXT2_PATH_MAX 字节
+ * @return int 结果超过 EXT2_PATH_MAX 时返回 FAILURE
+ */
+int normalizePath(const char* base, const char* path, char* out);
+
+/**
+ * @brief 从目录 cwd 出发一次解析多级路径，绝对路径从根目录出发。
+ *
+ * cwd 是文件系统的当前目录或者 path 是绝对路径时，先把 path 规范化，
+ * 再从路径前缀缓存中最长的已解析前缀开始逐级查找，解析到的目录记入缓存
+ *
+ * @param file_system
+ * @param cwd 相对路径的起点目录的 inode 序号
+ * @param path
+ * @param entry 返回目标的 inode 序号和类型，根目录的文件名为 "/"
+ * @param inode 返回目标的 inode
+ * @return int 路径中某一级不存在或不是目录时返回 FAILURE
+ */
+int resolvePath(Ext2FileSystem* file_system, unsigned int cwd,
+                const char* path, Ext2DirEntry* entry, Ext2Inode* inode);
+
+/**
+ * @brief 解析 path 中最后一个文件名所在的目录，新建和删除文件时使用
+ *
+ * @param file_system
+ * @param cwd
+ * @param path
+ * @param dir_idx 返回所在目录的 inode 序号
+ * @param dir 返回所在目录的 inode
+ * @param name 返回最后一个文件名，至少 EXT2_PATH_MAX 字节
+ * @return int 所在目录不存在或 path 没有文件名 (如 "/") 时返回 FAILURE
+ */
+int resolveParent(Ext2FileSystem* file_system, unsigned int cwd,
+                  const char* path, unsigned int* dir_idx, Ext2Inode* dir,
+                  char* name);
+
+/**
+ * @brief 清空路径前缀缓存，删除目录和挂载时调用
+ *
+ * @param file_system
+ */
+void forgetPaths(Ext2FileSystem* file_system);
+
+#endif  // __PATH_H__
@@ -0,0 +1,99 @@
+#include "readdir.h"
+
+#include "icache.h"
+
+// 一个需要从 inode 表读取的 inode 及其在结果中的位置
+typedef struct PendingInode {
+  Ext2Location location;
+  unsigned int pos;
+} PendingInode;
+
+static int compareLocation(const void* a, const void* b) {
+  const Ext2Location* x = &((const PendingInode*)a)->location;
+  const Ext2Location* y = &((const PendingInode*)b)->location;
+  if (x->block_idx != y->block_idx) {
+    return (x->block_idx > y->block_idx) - (x->block_idx < y->block_idx);
+  }
+  return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+// 把 pending 中的 inode 按所在的 inode 表块分组，一次批量读入所有块
+static int loadPendingInodes(Disk* disk,
+                             Ext2DirEntryPlus* entries,
+                             PendingInode* pending,
+                             unsigned int n) {
+  if (n == 0) {
+    return SUCCESS;
+  }
+  qsort(pending, n, sizeof(PendingInode), compareLocation);
+  unsigned int blocks = 1;
+  for (unsigned int i = 1; i < n; i++) {
+    blocks +=
+        pending[i].location.block_idx != pending[i - 1].location.block_idx;
+  }
+  unsigned int block_size = disk->layout->block_size;
+  BYTE* pool = (BYTE*)malloc((size_t)blocks * block_size);
+  DiskRequest* requests = (DiskRequest*)malloc(blocks * sizeof(DiskRequest));
+  if (pool == NULL || requests == NULL) {
+    free(pool);
+    free(requests);
+    return FAILURE;
+  }
+  unsigned int m = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    if (i == 0 ||
+        pending[i].location.block_idx != pending[i - 1].location.block_idx) {
+      requests[m].block_idx = pending[i].location.block_idx;
+      requests[m].data = pool + (size_t)m * block_size;
+      m++;
+    }
+  }
+  int ret = readBlocks(disk, requests, blocks);
+  if (ret == SUCCESS) {
+    m = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      if (i > 0 &&
+          pending[i].location.block_idx != pending[i - 1].location.block_idx) {
+        m++;
+      }
+      Ext2Inode* inode = &entries[pending[i].pos].inode;
+      memset(inode, 0, sizeof(Ext2Inode));
+      memcpy(inode, (BYTE*)requests[m].data + pending[i].location.offset,
+             INODE_SIZE);
+    }
+  }
+  free(requests);
+  free(pool);
+  return ret;
+}
+
+int readDirPlus(Ext2DirIter* iter,
+                Ext2DirEntryPlus* entries,
+                unsigned int max,
+                unsigned int* count) {
+  Disk* disk = iter->disk;
+  InodeCache* icache = disk->layout->icache;
+  PendingInode* pending = (PendingInode*)malloc(max * sizeof(PendingInode));
+  if (pending == NULL) {
+    *count = 0;
+    return FAILURE;
+  }
+  unsigned int n = 0;
+  unsigned int got = 0;
+  while (got < max &&
+         dirIterNext(iter, &entries[got].entry, NULL) == SUCCESS) {
+    unsigned int inode_idx = entries[got].entry.inode;
+    // 缓存中的副本可能还没有写回 inode 表，必须优先使用
+    if (icache == NULL ||
+        peekInode(icache, inode_idx, &entries[got].inode) == FAILURE) {
+      pending[n].location = getInodeLocation(disk, inode_idx);
+      pending[n].pos = got;
+      n++;
+    }
+    got++;
+  }
+  int ret = loadPendingInodes(disk, entries, pending, n);
+  free(pending);
+  *count = got;
+  return ret;
+}
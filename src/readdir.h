@@ -0,0 +1,40 @@
+#ifndef __READDIR_H__
+#define __READDIR_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "disk.h"
+#include "ext2.h"
+
+// readDirPlus 每批最多返回的目录项数
+#define EXT2_READDIR_BATCH 128
+
+/**
+ * @brief 目录项及其 inode
+ *
+ */
+typedef struct Ext2DirEntryPlus {
+  Ext2DirEntry entry;
+  Ext2Inode inode;
+} Ext2DirEntryPlus;
+
+/**
+ * @brief 从迭代器中取出下一批目录项，并一起读出它们的 inode。
+ *
+ * 先收集这一批目录项的 inode 序号，已在 inode 缓存中的直接复制，其余的按
+ * 在 inode 表中的位置排序，每个 inode 表块只读一次，所有块合并成一次批量
+ * 读。读出的 inode 不放入 inode 缓存，列出大目录不会把缓存冲掉
+ *
+ * @param iter 目录迭代器，遍历期间不能修改目录
+ * @param entries 至少 max 项
+ * @param max 最多取出的目录项数
+ * @param count 返回取出的目录项数，为 0 时目录已经遍历完
+ * @return int
+ */
+int readDirPlus(Ext2DirIter* iter, Ext2DirEntryPlus* entries,
+                unsigned int max, unsigned int* count);
+
+#endif  // __READDIR_H__
@@ -7,11 +7,9 @@ static Command commands[] = {
     {"rmdir", &shell_rmdir}, {"rm", &shell_rm},       {"write", &shell_write},
     {"cat", &shell_cat},     {"pwd", &shell_pwd},     {"help", &shell_help},
     {"clear", &shell_clear}, {"chmod", &shell_chmod}, {"info", &shell_info},
-    {"tree", &shell_tree},
+    {"tree", &shell_tree},   {"sync", &shell_sync},
 };
 
-char* path_stack[256];
-static int stack_top = -1;
 static ShellEntry shell_entry;
 int is_mounted = 0;
 
@@ -24,23 +22,84 @@ int getCurrentPath(char* path) {
   if (!is_mounted) {
     strcpy(path, "UNMOUNTED");
   } else {
-    strcpy(path, path_stack[stack_top]);
+    // 提示符只显示当前目录的最后一级
+    char* cwd_path = shell_entry.file_system.cwd_path;
+    char* last = strrchr(cwd_path, '/');
+    strcpy(path, last[1] == '\0' ? cwd_path : last + 1);
   }
   return 1;
 }
 
+// 解析 path 所在的目录和最后一个文件名。所在目录是当前目录时返回
+// current_user 本身，操作对目录的修改会同步到 shell 保存的当前目录
+static Ext2Inode* resolveTarget(char* path, Ext2Inode* dir, char* name) {
+  Ext2FileSystem* file_system = &shell_entry.file_system;
+  unsigned int dir_idx;
+  if (resolveParent(file_system, file_system->cwd, path, &dir_idx, dir,
+                    name) == FAILURE) {
+    printf("There's no directory for \"%s\"\n", path);
+    return NULL;
+  }
+  if (dir_idx == file_system->cwd) {
+    return &shell_entry.current_user;
+  }
+  return dir;
+}
+
+// 解析 path 所指的目录，path 为 NULL 时就是当前目录
+static Ext2Inode* resolveDir(char* path, Ext2Inode* dir, unsigned int* idx) {
+  Ext2FileSystem* file_system = &shell_entry.file_system;
+  if (path == NULL) {
+    *idx = file_system->cwd;
+    return &shell_entry.current_user;
+  }
+  Ext2DirEntry entry;
+  if (resolvePath(file_system, file_system->cwd, path, &entry, dir) ==
+          FAILURE ||
+      entry.file_type != EXT2_DIR) {
+    printf("There's no directory named \"%s\"\n", path);
+    return NULL;
+  }
+  *idx = entry.inode;
+  return dir;
+}
+
+UINT64 parseSize(const char* str) {
+  char* end;
+  UINT64 size = strtoull(str, &end, 10);
+  switch (*end) {
+    case 'K':
+    case 'k':
+      return size << 10;
+    case 'M':
+    case 'm':
+      return size << 20;
+    case 'G':
+    case 'g':
+      return size << 30;
+    default:
+      return size;
+  }
+}
+
 int shell_mkdsk(char** args) {
   if (is_mounted == 1) {
     printf("You're already mount on the disk, please umount before mkdsk\n");
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: makedisk <disk-name>\n");
+    printf("usage: mkdsk <disk-name> [size, e.g. 64M]\n");
     return 1;
   }
+  UINT64 size = DEFAULT_DISK_SIZE;
+  if (args[2] != NULL) {
+    size = parseSize(args[2]);
+  }
 
   Disk disk;
-  makeDisk(&disk, args[1]);
+  if (makeDisk(&disk, args[1], size) == SUCCESS) {
+    closeDisk(&disk);
+  }
   return 1;
 }
 
@@ -50,7 +109,9 @@ int shell_format(char** args) {
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: format <disk-name>\n");
+    printf(
+        "usage: format <disk-name> [block-size] [inode-ratio] [extents] "
+        "[dir_index]\n");
     return 1;
   }
   if (access(args[1], F_OK) == -1) {
@@ -60,9 +121,29 @@ int shell_format(char** args) {
         args[1]);
     return 1;
   }
+  unsigned int block_size = DEFAULT_BLOCK_SIZE;
+  unsigned int inode_ratio = DEFAULT_INODE_RATIO;
+  UINT32 features = 0;
+  UINT32 compat_features = 0;
+  // 数字依次是块大小和 inode 比例，特性名可以出现在任意位置
+  int numbers = 0;
+  for (int i = 2; args[i] != NULL; i++) {
+    if (!strcmp(args[i], "extents")) {
+      features |= EXT2_FEATURE_INCOMPAT_EXTENTS;
+    } else if (!strcmp(args[i], "dir_index")) {
+      compat_features |= EXT2_FEATURE_COMPAT_DIR_INDEX;
+    } else if (numbers++ == 0) {
+      block_size = parseSize(args[i]);
+    } else {
+      inode_ratio = parseSize(args[i]);
+    }
+  }
   Disk disk;
-  loadDisk(&disk, args[1]);
-  ext2Format(&disk);
+  if (loadDisk(&disk, args[1]) == FAILURE) {
+    return 1;
+  }
+  ext2Format(&disk, block_size, inode_ratio, features, compat_features);
+  closeDisk(&disk);
 
   return 1;
 }
@@ -73,7 +154,8 @@ int shell_mount(char** args) {
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: mount <disk-name>\n");
+    printf(
+        "usage: mount <disk-name> [cache-blocks] [writeback] [mmap|uring]\n");
     return 1;
   }
   if (access(args[1], F_OK) == -1) {
@@ -89,7 +171,25 @@ int shell_mount(char** args) {
     printf("Please format the disk first!\n");
     return 1;
   }
-  ext2Mount(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2MountOptions options;
+  options.cache_blocks = DEFAULT_CACHE_BLOCKS;
+  options.write_back = 0;
+  options.backend = DISK_BACKEND_PREAD;
+  for (int i = 2; args[i] != NULL; i++) {
+    if (!strcmp(args[i], "writeback")) {
+      options.write_back = 1;
+    } else if (!strcmp(args[i], "mmap")) {
+      options.backend = DISK_BACKEND_MMAP;
+    } else if (!strcmp(args[i], "uring")) {
+      options.backend = DISK_BACKEND_URING;
+    } else {
+      options.cache_blocks = atoi(args[i]);
+    }
+  }
+  if (ext2Mount(&shell_entry.file_system, &shell_entry.current_user, args[1],
+                &options) == FAILURE) {
+    return 1;
+  }
 
   is_mounted = 1;
   shell_help(NULL);
@@ -101,19 +201,38 @@ int shell_umount(char** args) {
     printf("The Ext2 File System is not mounted\n");
     return 1;
   }
+  int ret = ext2Umount(&shell_entry.file_system);
   is_mounted = 0;
-  stack_top = 0;
-  path_stack[stack_top] = "/";
+  if (ret == FAILURE) {
+    printf("Some data could not be written before umount\n");
+    return 1;
+  }
   printf("Successfully umount from the virtual file system\n");
   return 1;
 }
 
+int shell_sync(char** args) {
+  if (is_mounted == 0) {
+    shellLaunch(args);
+    return 1;
+  }
+  if (ext2Sync(&shell_entry.file_system) == FAILURE) {
+    printf("Some data could not be written, it is kept in memory\n");
+  }
+  return 1;
+}
+
 int shell_ls(char** args) {
   if (is_mounted == 0) {
     shellLaunch(args);
     return 1;
   }
-  ext2Ls(&shell_entry.file_system, &shell_entry.current_user);
+  Ext2Inode inode;
+  unsigned int inode_idx;
+  Ext2Inode* dir = resolveDir(args[1], &inode, &inode_idx);
+  if (dir != NULL) {
+    ext2Ls(&shell_entry.file_system, dir);
+  }
   return 1;
 }
 
@@ -122,7 +241,14 @@ int shell_tree(char** args) {
     shellLaunch(args);
     return 1;
   }
-  ext2Tree(&shell_entry.file_system, 0, 0, &shell_entry.current_user);
+  // 不带参数时从根目录开始
+  Ext2Inode inode;
+  unsigned int inode_idx;
+  if (resolveDir(args[1] == NULL ? "/" : args[1], &inode, &inode_idx) !=
+      NULL) {
+    ext2Tree(&shell_entry.file_system, inode_idx, 0,
+             &shell_entry.current_user);
+  }
   return 1;
 }
 
@@ -133,11 +259,16 @@ int shell_mkdir(char** args) {
   }
 
   if (args[1] == NULL) {
-    printf("usage: mkdir <dir-name>\n");
+    printf("usage: mkdir <path>\n");
     return 1;
   }
 
-  ext2Mkdir(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[1], &inode, name);
+  if (dir != NULL) {
+    ext2Mkdir(&shell_entry.file_system, dir, name);
+  }
   return 1;
 }
 
@@ -148,11 +279,16 @@ int shell_touch(char** args) {
   }
 
   if (args[1] == NULL) {
-    printf("usage: touch <file-name>\n");
+    printf("usage: touch <path>\n");
     return 1;
   }
 
-  ext2Touch(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[1], &inode, name);
+  if (dir != NULL) {
+    ext2Touch(&shell_entry.file_system, dir, name);
+  }
   return 1;
 }
 
@@ -163,7 +299,7 @@ int shell_chmod(char** args) {
   }
 
   if (args[2] == NULL) {
-    printf("usage: chmod <mode> <file-name>\n");
+    printf("usage: chmod <mode> <path>\n");
     printf(" <mode>:\n");
     printf("       0 : Toggle Readable\n");
     printf("       1 : Toggle Writable\n");
@@ -175,14 +311,19 @@ int shell_chmod(char** args) {
   } else if (!strcmp(args[1], "1")) {
     mode = 1;
   } else {
-    printf("usage: chmod <mode> <file-name>\n");
+    printf("usage: chmod <mode> <path>\n");
     printf(" <mode>:\n");
     printf("       0 : Toggle Readable\n");
     printf("       1 : Toggle Writable\n");
     return 1;
   }
 
-  ext2Chmod(&shell_entry.file_system, &shell_entry.current_user, mode, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[2], &inode, name);
+  if (dir != NULL) {
+    ext2Chmod(&shell_entry.file_system, dir, mode, name);
+  }
   return 1;
 }
 
@@ -209,30 +350,11 @@ int shell_cd(char** args) {
   }
 
   if (args[1] == NULL) {
-    printf("usage: cd <dir-name>\n");
+    printf("usage: cd <path>\n");
     return 1;
   }
-  if (!strcmp(args[1], "..")) {
-    // 返回上级目录，栈顶减小
-    if (stack_top > 0)
-      stack_top--;
-    ext2Open(&shell_entry.file_system, &shell_entry.current_user, args[1]);
-    return 1;
-  } else if (!strcmp(args[1], ".")) {
-    // 当前目录，不处理
-    return 1;
-  } else if (!strcmp(args[1], "/")) {
-    stack_top = 0;
-    path_stack[stack_top] = "/";
-    ext2Open(&shell_entry.file_system, &shell_entry.current_user, args[1]);
-  }
-
-  if (ext2Open(&shell_entry.file_system, &shell_entry.current_user, args[1]) ==
-      SUCCESS) {
-    stack_top++;
-    path_stack[stack_top] = malloc(128 * sizeof(char*));
-    strcpy(path_stack[stack_top], args[1]);
-  }
+  // 当前目录的路径由 ext2Open 维护
+  ext2Open(&shell_entry.file_system, &shell_entry.current_user, args[1]);
   return 1;
 }
 
@@ -242,11 +364,16 @@ int shell_rm(char** args) {
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: rm <file-name>\n");
+    printf("usage: rm <path>\n");
     return 1;
   }
 
-  ext2Rm(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[1], &inode, name);
+  if (dir != NULL) {
+    ext2Rm(&shell_entry.file_system, dir, name);
+  }
 
   return 1;
 }
@@ -257,11 +384,16 @@ int shell_rmdir(char** args) {
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: rm <file-name>\n");
+    printf("usage: rmdir <path>\n");
     return 1;
   }
 
-  ext2Rmdir(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[1], &inode, name);
+  if (dir != NULL) {
+    ext2Rmdir(&shell_entry.file_system, dir, name);
+  }
 
   return 1;
 }
@@ -272,11 +404,16 @@ int shell_write(char** args) {
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: write <file-name>\n");
+    printf("usage: write <path>\n");
     return 1;
   }
 
-  ext2Write(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[1], &inode, name);
+  if (dir != NULL) {
+    ext2Write(&shell_entry.file_system, dir, name);
+  }
 
   return 1;
 }
@@ -287,11 +424,16 @@ int shell_cat(char** args) {
     return 1;
   }
   if (args[1] == NULL) {
-    printf("usage: cat <file-name>\n");
+    printf("usage: cat <path>\n");
     return 1;
   }
 
-  ext2Cat(&shell_entry.file_system, &shell_entry.current_user, args[1]);
+  Ext2Inode inode;
+  char name[EXT2_PATH_MAX];
+  Ext2Inode* dir = resolveTarget(args[1], &inode, name);
+  if (dir != NULL) {
+    ext2Cat(&shell_entry.file_system, dir, name);
+  }
 
   return 1;
 }
@@ -302,10 +444,7 @@ int shell_pwd(char** args) {
     return 1;
   }
 
-  for (int i = 0; i < stack_top; i++) {
-    printf("%s/", path_stack[i]);
-  }
-  printf("\n");
+  printf("%s\n", shell_entry.file_system.cwd_path);
 
   return 1;
 }
@@ -317,24 +456,28 @@ int shell_help(char** args) {
         "You can use almost all the command as usual if you are not mount on "
         "the disk\n");
     printf("There are some built in command you can use:\n");
-    printf("    mkdsk <path>\n");
-    printf("    format <path>\n");
-    printf("    mount <path>\n");
+    printf("    mkdsk <path> [size]\n");
+    printf(
+        "    format <path> [block-size] [inode-ratio] [extents] "
+        "[dir_index]\n");
+    printf("    mount <path> [cache-blocks] [writeback] [mmap|uring]\n");
     printf("    help    show this information again\n");
     printf("    exit    quit this program\n");
   } else {
     printf("You have already mounted on ext2 file system!\n");
     printf("Following commands you can use:\n");
-    printf("    mkdir <name>\n");
-    printf("    touch <name>\n");
-    printf("    chmod <name>\n");
-    printf("    write <name>\n");
-    printf("    cat <name>\n");
+    printf("    mkdir <path>\n");
+    printf("    touch <path>\n");
+    printf("    chmod <mode> <path>\n");
+    printf("    write <path>\n");
+    printf("    cat <path>\n");
     printf("    pwd\n");
-    printf("    ls\n");
+    printf("    ls [path]\n");
+    printf("    tree [path]\n");
     printf("    cd <path>\n");
-    printf("    rm <name>\n");
-    printf("    rmdir <name>\n");
+    printf("    rm <path>\n");
+    printf("    rmdir <path>\n");
+    printf("    sync    write dirty blocks back to the disk\n");
     printf("    umount  unmount the file system\n");
     printf("    help    show this information again\n");
     printf("    exit    quit this program\n");
@@ -348,6 +491,10 @@ int shell_clear(char** args) {
 }
 
 int shell_exit(char** args) {
+  if (is_mounted == 1) {
+    // 退出前写回尚未落盘的数据
+    ext2Umount(&shell_entry.file_system);
+  }
   printf("Bye!\n");
   exit(0);
 }
@@ -449,7 +596,7 @@ int shellLoop() {
   int status;
 
   do {
-    char current_path[32] = {0};
+    char current_path[EXT2_PATH_MAX] = {0};
     getCurrentPath(current_path);
     printf("%s > ", current_path);
     line = shellReadLine();
@@ -465,8 +612,6 @@ int shellLoop() {
 void shellStart() {
   printf("Hello! Welcome to this toy EXT2 FILE SYSTEM\n");
   printf("Print \"help\" to see more information\n");
-  stack_top = 0;
-  path_stack[stack_top] = "/";
   shellLoop();
   exitDisplay();
 }
@@ -14,6 +14,7 @@
 
 #include "common.h"
 #include "ext2.h"
+#include "path.h"
 
 #define TOK_BUFSIZE 64
 #define TOK_DELIM " \t\r\n\a"
@@ -29,12 +30,14 @@ typedef struct Command {
 } Command;
 
 void exitDisplay();
+UINT64 parseSize(const char* str);
 int getCurrentPath(char* path);
 
 int shell_mkdsk(char** args);
 int shell_format(char** args);
 int shell_mount(char** args);
 int shell_umount(char** args);
+int shell_sync(char** args);
 int shell_ls(char** args);
 int shell_tree(char** args);
 int shell_mkdir(char** args);
@@ -0,0 +1,255 @@
+#include <linux/io_uring.h>
+#undef BLOCK_SIZE
+#undef BLOCK_SIZE_BITS
+
+#include "uring.h"
+
+static int ioUringSetup(unsigned int entries, struct io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int ring_fd,
+                        unsigned int to_submit,
+                        unsigned int min_complete,
+                        unsigned int flags) {
+  return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+                      flags, NULL, 0);
+}
+
+UringQueue* createUringQueue(unsigned int entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int ring_fd = ioUringSetup(entries, &params);
+  if (ring_fd < 0) {
+    return NULL;
+  }
+
+  UringQueue* queue = (UringQueue*)malloc(sizeof(UringQueue));
+  if (queue == NULL) {
+    close(ring_fd);
+    return NULL;
+  }
+  memset(queue, 0, sizeof(UringQueue));
+  queue->ring_fd = ring_fd;
+  queue->entries = params.sq_entries;
+
+  queue->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  queue->cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  int single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    // 两个队列共用一次映射
+    if (queue->cq_size > queue->sq_size) {
+      queue->sq_size = queue->cq_size;
+    }
+    queue->cq_size = queue->sq_size;
+  }
+  queue->sq_ptr = mmap(NULL, queue->sq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  if (queue->sq_ptr == MAP_FAILED) {
+    close(ring_fd);
+    free(queue);
+    return NULL;
+  }
+  if (single_mmap) {
+    queue->cq_ptr = queue->sq_ptr;
+  } else {
+    queue->cq_ptr =
+        mmap(NULL, queue->cq_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (queue->cq_ptr == MAP_FAILED) {
+      munmap(queue->sq_ptr, queue->sq_size);
+      close(ring_fd);
+      free(queue);
+      return NULL;
+    }
+  }
+  queue->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  queue->sqes = (struct io_uring_sqe*)mmap(
+      NULL, queue->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      ring_fd, IORING_OFF_SQES);
+  if (queue->sqes == MAP_FAILED) {
+    if (!single_mmap) {
+      munmap(queue->cq_ptr, queue->cq_size);
+    }
+    munmap(queue->sq_ptr, queue->sq_size);
+    close(ring_fd);
+    free(queue);
+    return NULL;
+  }
+
+  BYTE* sq = (BYTE*)queue->sq_ptr;
+  BYTE* cq = (BYTE*)queue->cq_ptr;
+  queue->sq_head = (unsigned int*)(sq + params.sq_off.head);
+  queue->sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+  queue->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+  queue->sq_array = (unsigned int*)(sq + params.sq_off.array);
+  queue->cq_head = (unsigned int*)(cq + params.cq_off.head);
+  queue->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+  queue->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+  queue->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+  return queue;
+}
+
+void destroyUringQueue(UringQueue* queue) {
+  if (queue == NULL) {
+    return;
+  }
+  uringWait(queue);
+  munmap(queue->sqes, queue->sqes_size);
+  if (queue->cq_ptr != queue->sq_ptr) {
+    munmap(queue->cq_ptr, queue->cq_size);
+  }
+  munmap(queue->sq_ptr, queue->sq_size);
+  close(queue->ring_fd);
+  free(queue);
+}
+
+// 取出完成队列中所有已完成的请求
+static void reapCompletions(UringQueue* queue) {
+  unsigned int head = *queue->cq_head;
+  while (head != __atomic_load_n(queue->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe* cqe = &queue->cqes[head & *queue->cq_mask];
+    // user_data 记录写请求的长度；读到磁盘文件末尾之后时 res 可能不足一个块，
+    // 缓冲区已预先清零
+    if (cqe->res < 0 ||
+        (cqe->user_data != 0 && cqe->res != (int)cqe->user_data)) {
+      queue->failed = 1;
+    }
+    queue->inflight--;
+    head++;
+  }
+  __atomic_store_n(queue->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// 提交尚未提交的请求，并至少等待 min_complete 个请求完成
+static int enterRing(UringQueue* queue, unsigned int min_complete) {
+  unsigned int flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  while (1) {
+    int ret = ioUringEnter(queue->ring_fd, queue->pending, min_complete, flags);
+    if (ret >= 0) {
+      queue->pending -= ret;
+      break;
+    }
+    if (errno != EINTR) {
+      return FAILURE;
+    }
+  }
+  reapCompletions(queue);
+  return SUCCESS;
+}
+
+int uringQueueRequest(UringQueue* queue,
+                      Disk* disk,
+                      DiskRequest* request,
+                      int write) {
+  if (queue->inflight >= queue->entries) {
+    // 队列已满，先让一部分请求完成
+    if (enterRing(queue, 1) == FAILURE) {
+      return FAILURE;
+    }
+  }
+  unsigned int tail = *queue->sq_tail;
+  unsigned int idx = tail & *queue->sq_mask;
+  struct io_uring_sqe* sqe = &queue->sqes[idx];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = disk->fd;
+  sqe->addr = (unsigned long)request->data;
+  sqe->len = disk->block_size;
+  sqe->off = (UINT64)request->block_idx * disk->block_size;
+  sqe->user_data = write ? disk->block_size : 0;
+  queue->sq_array[idx] = idx;
+  __atomic_store_n(queue->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  queue->pending++;
+  queue->inflight++;
+  return SUCCESS;
+}
+
+int uringSubmit(UringQueue* queue) {
+  if (queue->pending == 0) {
+    return SUCCESS;
+  }
+  return enterRing(queue, 0);
+}
+
+int uringWait(UringQueue* queue) {
+  while (queue->inflight > 0) {
+    if (enterRing(queue, queue->inflight) == FAILURE) {
+      return FAILURE;
+    }
+  }
+  int ret = queue->failed ? FAILURE : SUCCESS;
+  queue->failed = 0;
+  return ret;
+}
+
+int loadDiskUring(Disk* disk, const char* path) {
+  if (loadDisk(disk, path) == FAILURE) {
+    return FAILURE;
+  }
+  disk->uring = createUringQueue(URING_ENTRIES);
+  if (disk->uring == NULL) {
+    printf("io_uring is not available, fall back to pread/pwrite\n");
+    return SUCCESS;
+  }
+  disk->read_disk_v = &readDiskUringV;
+  disk->write_disk_v = &writeDiskUringV;
+  return SUCCESS;
+}
+
+int submitDiskRequests(Disk* disk,
+                       DiskRequest* requests,
+                       unsigned int count,
+                       int write) {
+  if (disk->uring == NULL) {
+    // 没有 io_uring 时同步完成
+    return write ? disk->write_disk_v(disk, requests, count)
+                 : disk->read_disk_v(disk, requests, count);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    if (requests[i].block_idx >= disk->blocks_count) {
+      printf(write ? "failed to write\n" : "failed to read\n");
+      return FAILURE;
+    }
+    if (!write) {
+      memset(requests[i].data, 0, disk->block_size);
+    }
+    if (uringQueueRequest(disk->uring, disk, &requests[i], write) ==
+        FAILURE) {
+      return FAILURE;
+    }
+  }
+  return uringSubmit(disk->uring);
+}
+
+int waitDiskRequests(Disk* disk) {
+  if (disk->uring == NULL) {
+    return SUCCESS;
+  }
+  return uringWait(disk->uring);
+}
+
+int writeDiskUringV(Disk* disk, DiskRequest* requests, unsigned int count) {
+  if (submitDiskRequests(disk, requests, count, 1) == FAILURE) {
+    waitDiskRequests(disk);
+    return FAILURE;
+  }
+  if (waitDiskRequests(disk) == FAILURE) {
+    printf("failed to write\n");
+    return FAILURE;
+  }
+  return SUCCESS;
+}
+
+int readDiskUringV(Disk* disk, DiskRequest* requests, unsigned int count) {
+  if (submitDiskRequests(disk, requests, count, 0) == FAILURE) {
+    waitDiskRequests(disk);
+    return FAILURE;
+  }
+  if (waitDiskRequests(disk) == FAILURE) {
+    printf("failed to read\n");
+    return FAILURE;
+  }
+  return SUCCESS;
+}
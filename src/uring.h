@@ -0,0 +1,138 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "disk.h"
+
+#define URING_ENTRIES 64
+
+// <linux/io_uring.h> 会引入 <linux/fs.h> 中的 BLOCK_SIZE，只在 uring.c 中包含
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/**
+ * @brief io_uring 提交队列与完成队列，直接通过系统调用使用，不依赖 liburing
+ *
+ */
+typedef struct UringQueue {
+  int ring_fd;            // io_uring 的文件描述符
+  unsigned int entries;   // 提交队列长度
+  unsigned int inflight;  // 已入队但尚未完成的请求数
+  unsigned int pending;   // 已入队但尚未提交给内核的请求数
+  int failed;             // 上次等待以来是否有请求失败
+
+  void* sq_ptr;           // 提交队列映射
+  size_t sq_size;
+  void* cq_ptr;           // 完成队列映射，可能与 sq_ptr 相同
+  size_t cq_size;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+
+  unsigned int* sq_head;
+  unsigned int* sq_tail;
+  unsigned int* sq_mask;
+  unsigned int* sq_array;
+  unsigned int* cq_head;
+  unsigned int* cq_tail;
+  unsigned int* cq_mask;
+  struct io_uring_cqe* cqes;
+} UringQueue;
+
+/**
+ * @brief 创建一个 io_uring 队列
+ *
+ * @param entries 队列长度
+ * @return UringQueue* 内核不支持 io_uring 时返回 NULL
+ */
+UringQueue* createUringQueue(unsigned int entries);
+
+void destroyUringQueue(UringQueue* queue);
+
+/**
+ * @brief 将一次块读写放入提交队列，队列满时先等待已提交的请求完成
+ *
+ * @param queue
+ * @param disk 请求的磁盘
+ * @param request 请求，data 在完成前必须保持有效
+ * @param write 为 1 时写，为 0 时读
+ * @return int
+ */
+int uringQueueRequest(UringQueue* queue, Disk* disk, DiskRequest* request,
+                      int write);
+
+/**
+ * @brief 将队列中所有请求一次性提交给内核，不等待完成
+ *
+ * @param queue
+ * @return int
+ */
+int uringSubmit(UringQueue* queue);
+
+/**
+ * @brief 提交剩余请求并等待所有请求完成
+ *
+ * @param queue
+ * @return int 有请求失败时返回 FAILURE
+ */
+int uringWait(UringQueue* queue);
+
+/**
+ * @brief 加载磁盘并使用 io_uring 作为批量读写后端，内核不支持时退回
+ * pread/pwrite
+ *
+ * @param disk
+ * @param path
+ * @return int
+ */
+int loadDiskUring(Disk* disk, const char* path);
+
+/**
+ * @brief io_uring 后端的批量写，所有请求一次提交并等待完成
+ *
+ * @param disk
+ * @param requests
+ * @param count
+ * @return int
+ */
+int writeDiskUringV(Disk* disk, DiskRequest* requests, unsigned int count);
+
+/**
+ * @brief io_uring 后端的批量读，所有请求一次提交并等待完成
+ *
+ * @param disk
+ * @param requests
+ * @param count
+ * @return int
+ */
+int readDiskUringV(Disk* disk, DiskRequest* requests, unsigned int count);
+
+/**
+ * @brief 异步提交一批块读写，供预读、写回等需要多个请求同时在途的场景使用。
+ * 没有 io_uring 时同步完成
+ *
+ * @param disk
+ * @param requests 请求数组，data 在 waitDiskRequests 返回前必须保持有效
+ * @param count
+ * @param write 为 1 时写，为 0 时读
+ * @return int
+ */
+int submitDiskRequests(Disk* disk, DiskRequest* requests, unsigned int count,
+                       int write);
+
+/**
+ * @brief 等待所有通过 submitDiskRequests 提交的请求完成
+ *
+ * @param disk
+ * @return int
+ */
+int waitDiskRequests(Disk* disk);
+
+#endif  // __URING_H__